@@ -0,0 +1,196 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "batch.h"
+#include "rendercontext.h"
+#include "image.h"
+#include "threadpool.h"
+#include <sstream>
+#include <iomanip>
+#include <memory>
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+bool Batch::loadJob(const std::string &filename, BatchJob &job) {
+	ifstream file(filename.c_str());
+	if (!file) {
+		cout << "Can't open file '" << filename << "'!" << endl;
+		return false;
+	}
+
+	job.output = "frame";
+	job.width = 1060;
+	job.height = 600;
+	job.samples = 16;
+	job.device = "";
+	job.frames.clear();
+
+	vector<BatchInstanceDelta> deltas;
+	int deltaLine = 0;	// first instance line not yet applied by a frame
+	string line;
+	for (int lineNumber = 1; getline(file, line); lineNumber++) {
+		istringstream stream(line);
+		string command;
+		if (!(stream >> command) || command[0] == '#')
+			continue;
+
+		bool valid = true;
+		if (command == "output") {
+			valid = !!(stream >> job.output);
+		}
+		else if (command == "size") {
+			valid = (stream >> job.width >> job.height) && job.width > 0 && job.height > 0;
+		}
+		else if (command == "samples") {
+			valid = (stream >> job.samples) && job.samples > 0;
+		}
+		else if (command == "device") {
+			valid = (stream >> job.device) && Raytracer::isOpenCLDevice(job.device);
+		}
+		else if (command == "instance") {
+			BatchInstanceDelta delta;
+			valid = !!(stream >> delta.instance >> delta.position[0] >> delta.position[1] >> delta.position[2] >> delta.scale);
+			if (valid && deltas.empty())
+				deltaLine = lineNumber;
+			if (valid)
+				deltas.push_back(delta);
+		}
+		else if (command == "frame") {
+			BatchFrame frame;
+			valid = !!(stream >> frame.position[0] >> frame.position[1] >> frame.position[2] >> frame.lookAt[0] >> frame.lookAt[1] >> frame.lookAt[2]);
+			frame.deltas.swap(deltas);
+			job.frames.push_back(frame);
+		}
+		else {
+			valid = false;
+		}
+
+		if (!valid) {
+			cout << filename << ":" << lineNumber << ": invalid line '" << line << "'!" << endl;
+			return false;
+		}
+	}
+
+	if (job.frames.empty()) {
+		cout << "No frames in '" << filename << "'!" << endl;
+		return false;
+	}
+	if (!deltas.empty()) {
+		cout << filename << ":" << deltaLine << ": instance after last frame is never rendered!" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool Batch::run(OpenCLManager *manager, std::vector<SceneInstance> instances, const BatchJob &job, const std::string &kernelOptions) {
+	RenderContext *context = Raytracer::createRenderContext(manager, job.width, job.height, job.samples, kernelOptions);
+	if (context == NULL) {
+		cout << "RenderContext can't create!" << endl;
+		return false;
+	}
+	context->setScene(instances);
+
+	// bounded queue stops rendering when encoding falls behind, so memory stays flat on long jobs
+	unsigned threads = max(thread::hardware_concurrency(), 1u);
+	ThreadPool pool(threads, 2 * threads);
+	atomic<unsigned> failures(0);
+	double deviceTime = 0;
+	size_t copiedBytes = 0;
+	size_t finished = 0;	// read back and handed over to the pool, less than job.frames.size() when aborted
+
+	// waits for frame readback and hands encoding and writing over to the pool
+	auto finishFrame = [&](size_t frame) -> bool {
+		RenderFrame rendered;
+		if (!context->readback(rendered))
+			return false;
+		deviceTime += rendered.renderTime;
+		copiedBytes += rendered.copiedBytes;
+
+		shared_ptr<vector<unsigned char> > rgb(new vector<unsigned char>(3 * rendered.width * rendered.height));
+		frameToRGB(rendered, &(*rgb)[0]);
+
+		ostringstream filename;
+		filename << job.output << setw(4) << setfill('0') << frame << ".ppm";
+		string name = filename.str();
+		unsigned width = rendered.width, height = rendered.height;
+		pool.enqueue([rgb, name, width, height, &failures]() {
+			if (!saveImagePPM(name, &(*rgb)[0], width, height))
+				failures++;
+		});
+		finished++;
+		return true;
+	};
+
+	// frame N+1 is enqueued before frame N is read back
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	bool result = true;
+	for (size_t i = 0; i < job.frames.size() && result; i++) {
+		const BatchFrame &frame = job.frames[i];
+
+		for (size_t j = 0; j < frame.deltas.size(); j++) {
+			const BatchInstanceDelta &delta = frame.deltas[j];
+			if (delta.instance < 0 || delta.instance >= (int)instances.size()) {
+				cout << "Frame " << i << ": no instance " << delta.instance << "!" << endl;
+				result = false;
+				break;
+			}
+			CVector3D position(delta.position[0], delta.position[1], delta.position[2]);
+			instances[delta.instance] = Raytracer::createSceneInstance(instances[delta.instance].object,
+				CMatrix4x4::translation(position) * CMatrix4x4::scaling(delta.scale), instances[delta.instance].material);
+		}
+		if (!result)
+			break;
+		if (!frame.deltas.empty())
+			context->setScene(instances);
+
+		CVector3D position(frame.position[0], frame.position[1], frame.position[2]);
+		CVector3D lookAt(frame.lookAt[0], frame.lookAt[1], frame.lookAt[2]);
+		context->setCamera(position, lookAt, CVector3D(0, 1, 0));
+		if (!context->renderAsync()) {
+			cout << "Frame " << i << " can't enqueue!" << endl;
+			result = false;
+			break;
+		}
+
+		if (i > 0)
+			result = finishFrame(i - 1);
+		if (result && i + 1 == job.frames.size())
+			result = finishFrame(i);
+	}
+
+	bool zeroCopy = context->isZeroCopy();
+	delete context;
+	pool.wait();
+
+	double seconds = chrono::duration_cast<chrono::duration<double> >(chrono::high_resolution_clock::now() - start).count();
+	size_t frames = max(finished, (size_t)1);
+	cout << "Frames:           " << finished << " of " << job.frames.size() << endl;
+	cout << "Time:             " << seconds << " s" << endl;
+	cout << "Device time:      " << deviceTime / frames << " ms/frame" << endl;
+	cout << "Copied:           " << copiedBytes / frames << " bytes/frame" << (zeroCopy ? " (zero-copy)" : "") << endl;
+	cout << "Frames per hour:  " << (seconds > 0 ? finished * 3600 / seconds : 0) << endl;
+	if (failures > 0) {
+		cout << failures << " frames can't save!" << endl;
+		result = false;
+	}
+	return result;
+}
@@ -0,0 +1,57 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef RAYTRACER_BATCH
+#define RAYTRACER_BATCH
+
+#include <string>
+#include <vector>
+
+#include "raytracer.h"
+
+// replaces transform of an instance, object and material stay the same
+struct BatchInstanceDelta {
+	int instance;
+	float position[3];
+	float scale;
+};
+
+struct BatchFrame {
+	float position[3];
+	float lookAt[3];	// point the camera looks at
+	std::vector<BatchInstanceDelta> deltas;	// applied before this frame, kept for next frames
+};
+
+struct BatchJob {
+	std::string output;	// frames are saved as <output>0000.ppm, <output>0001.ppm, ...
+	unsigned width;
+	unsigned height;
+	unsigned samples;
+	std::string device;	// as in Raytracer::createOpenCLManager, empty for the first GPU
+	std::vector<BatchFrame> frames;
+};
+
+class Batch {
+	public:
+		static bool loadJob(const std::string &filename, BatchJob &job);
+		static bool run(OpenCLManager *manager, std::vector<SceneInstance> instances, const BatchJob &job, const std::string &kernelOptions);
+};
+
+#endif
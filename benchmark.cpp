@@ -0,0 +1,102 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "benchmark.h"
+#include "mathematics.h"
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+using namespace std;
+
+const int VECTOR_COUNT = 1024;	// power of two, data stays in L1
+const int MATRIX_COUNT = 64;
+const int ITERATIONS = 10000000;
+
+// keeps results alive, so loops are not optimized away
+volatile float sink;
+
+template <typename Operation>
+static void measure(const char *name, int iterations, Operation operation) {
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	float result = operation(iterations);
+	double seconds = chrono::duration_cast<chrono::duration<double> >(chrono::high_resolution_clock::now() - start).count();
+	sink = result;
+	cout << setw(16) << left << name << right << setw(10) << seconds * 1e9 / iterations << " ns/op" << endl;
+}
+
+static float randomFloat() {
+	return (rand() % 2000) / 100.0f - 10;
+}
+
+void Benchmark::runMath() {
+#ifdef RAYTRACER_SSE
+	cout << "Math benchmark (SSE2)" << endl;
+#else
+	cout << "Math benchmark (scalar)" << endl;
+#endif
+
+	srand(1);
+	CVector3D vectors[VECTOR_COUNT];
+	for (int i = 0; i < VECTOR_COUNT; i++)
+		vectors[i] = CVector3D(randomFloat(), randomFloat(), randomFloat());
+	CMatrix4x4 matrices[MATRIX_COUNT];
+	for (int i = 0; i < MATRIX_COUNT; i++)
+		matrices[i] = CMatrix4x4::translation(vectors[i]) * CMatrix4x4::scaling(1 + i % 4);
+
+	cout << fixed << setprecision(2);
+	measure("dot", ITERATIONS, [&](int n) -> float {
+		float sum = 0;
+		for (int i = 0; i < n; i++)
+			sum += CVector3D::dot(vectors[i & (VECTOR_COUNT - 1)], vectors[(i + 1) & (VECTOR_COUNT - 1)]);
+		return sum;
+	});
+	measure("cross", ITERATIONS, [&](int n) -> float {
+		CVector3D sum;
+		for (int i = 0; i < n; i++)
+			sum += CVector3D::cross(vectors[i & (VECTOR_COUNT - 1)], vectors[(i + 1) & (VECTOR_COUNT - 1)]);
+		return sum.x + sum.y + sum.z;
+	});
+	measure("normalize", ITERATIONS, [&](int n) -> float {
+		CVector3D sum;
+		for (int i = 0; i < n; i++)
+			sum += CVector3D::normalize(vectors[i & (VECTOR_COUNT - 1)]);
+		return sum.x + sum.y + sum.z;
+	});
+	measure("matrix*point", ITERATIONS, [&](int n) -> float {
+		CVector3D sum;
+		for (int i = 0; i < n; i++)
+			sum += matrices[i & (MATRIX_COUNT - 1)].transformPoint(vectors[i & (VECTOR_COUNT - 1)]);
+		return sum.x + sum.y + sum.z;
+	});
+	measure("matrix*matrix", ITERATIONS / 10, [&](int n) -> float {
+		float sum = 0;
+		for (int i = 0; i < n; i++)
+			sum += (matrices[i & (MATRIX_COUNT - 1)] * matrices[(i + 1) & (MATRIX_COUNT - 1)]).data()[12];
+		return sum;
+	});
+	measure("inverseAffine", ITERATIONS / 10, [&](int n) -> float {
+		float sum = 0;
+		for (int i = 0; i < n; i++)
+			sum += CMatrix4x4::inverseAffine(matrices[i & (MATRIX_COUNT - 1)]).data()[12];
+		return sum;
+	});
+}
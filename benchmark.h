@@ -0,0 +1,30 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef RAYTRACER_BENCHMARK
+#define RAYTRACER_BENCHMARK
+
+// Times host math of mathematics.h, build with and without RAYTRACER_NO_SSE to compare.
+class Benchmark {
+	public:
+		static void runMath();
+};
+
+#endif
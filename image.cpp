@@ -0,0 +1,48 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "image.h"
+#include <fstream>
+using namespace std;
+
+bool saveImagePPM(const std::string &filename, const unsigned char *rgb, unsigned width, unsigned height) {
+	ofstream file(filename.c_str(), ofstream::binary);
+	if (!file)
+		return false;
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write((const char*)rgb, 3 * width * height);
+	return file.good();
+}
+bool loadImagePPM(const std::string &filename, std::vector<unsigned char> &rgb, unsigned &width, unsigned &height) {
+	ifstream file(filename.c_str(), ifstream::binary);
+	if (!file)
+		return false;
+
+	string magic;
+	unsigned maxValue = 0;
+	if (!(file >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255 || width == 0 || height == 0)
+		return false;
+	file.get();
+
+	rgb.resize(3 * width * height);
+	file.read((char*)&rgb[0], rgb.size());
+	return file.gcount() == (streamsize)rgb.size();
+}
@@ -0,0 +1,31 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef RAYTRACER_IMAGE
+#define RAYTRACER_IMAGE
+
+#include <string>
+#include <vector>
+
+// rgb rows stored top to bottom
+bool saveImagePPM(const std::string &filename, const unsigned char *rgb, unsigned width, unsigned height);
+bool loadImagePPM(const std::string &filename, std::vector<unsigned char> &rgb, unsigned &width, unsigned &height);	// binary P6 with maxval 255 only
+
+#endif
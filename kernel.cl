@@ -23,6 +23,26 @@ const __constant double EPS = 0.000001f;
 const __constant double MAX = 100000.0f;
 const __constant int MAX_OBJECTS = 1000;
 const __constant int MAX_LIGHTS = 1000;
+const __constant int MAX_MATERIALS = 100;
+
+// spheres tested together by testSphereGroup, 4 or 8 lanes
+#ifndef SPHERE_GROUP_WIDTH
+	#define SPHERE_GROUP_WIDTH 4
+#endif
+
+#if SPHERE_GROUP_WIDTH == 8
+	typedef float8 floatG;
+	typedef int8 intG;
+	#define SPHERE_GROUP_LANES (int8)(0, 1, 2, 3, 4, 5, 6, 7)
+	#define vloadG vload8
+	#define vstoreG vstore8
+#else
+	typedef float4 floatG;
+	typedef int4 intG;
+	#define SPHERE_GROUP_LANES (int4)(0, 1, 2, 3)
+	#define vloadG vload4
+	#define vstoreG vstore4
+#endif
 
 const __constant float3	WHITE		= (float3)(1, 1, 1);
 const __constant float3 BLACK		= (float3)(0, 0, 0);
@@ -44,6 +64,22 @@ float3 matrixByVector(__global float *matrix, float3 *vector){
 	return result;
 }
 
+float3 matrixByDirection(__global float *matrix, float3 *vector){ 
+	float3 result;
+	result.x = matrix[0]*(*vector).x + matrix[4]*(*vector).y + matrix[8]*(*vector).z;
+	result.y = matrix[1]*(*vector).x + matrix[5]*(*vector).y + matrix[9]*(*vector).z;
+	result.z = matrix[2]*(*vector).x + matrix[6]*(*vector).y + matrix[10]*(*vector).z;
+	return result;
+}
+
+float3 transposedMatrixByDirection(__global float *matrix, float3 *vector){ 
+	float3 result;
+	result.x = matrix[0]*(*vector).x + matrix[1]*(*vector).y + matrix[2]*(*vector).z;
+	result.y = matrix[4]*(*vector).x + matrix[5]*(*vector).y + matrix[6]*(*vector).z;
+	result.z = matrix[8]*(*vector).x + matrix[9]*(*vector).y + matrix[10]*(*vector).z;
+	return result;
+}
+
 float3 reflect(float3 vector, float3 normal) {
 	return -vector + 2*dot(normal, vector)*normal;
 }
@@ -66,22 +102,38 @@ struct HitTestResult {
 	bool hit;
 	float t;
 	float3 normal;
+	int lane;
 };
 
 struct HitInfo {
 	struct Scene *scene;
 	struct Ray *ray;
+	int instance;
 	struct Object *object;
+	struct Material *material;
+	int lane;
 	float3 normal;
 	float3 point;
 	int depth;
 };
 
+// primary hit data used by post processing
+struct Surface {
+	float3 albedo;
+	float3 normal;
+	float depth;
+};
+
 struct Scene {
-	struct Object *objects[MAX_OBJECTS];
+	struct Object *objects[MAX_OBJECTS];	// geometry shared by instances
 	int countObj;
+	struct Material *materials[MAX_MATERIALS];	// materials for instance overrides
+	int countMaterial;
+	__global struct Instance *instances;
+	int countInstance;
 	struct Light *lights[MAX_LIGHTS];
 	int countLight;
+	uint rayCount;	// camera and shadow rays traced by this work item
 };
 
 struct Scene createScene(int n) {
@@ -135,9 +187,130 @@ struct HitTestResult testSphere(struct Sphere *sphere, struct Ray *ray) {
 	result.hit = true;
 	result.t = t;
 	result.normal = normalize(ray->origin + ray->direction*t - sphere->center);
+	result.lane = -1;
 	return result;
 }
 
+struct SphereGroup {
+	floatG centerX;
+	floatG centerY;
+	floatG centerZ;
+	floatG radius;
+	struct Material *materials[SPHERE_GROUP_WIDTH];
+	int count;
+};
+
+struct SphereGroup createSphereGroup() {
+	struct SphereGroup result;
+	result.centerX = result.centerY = result.centerZ = result.radius = (floatG)(0);
+	result.count = 0;
+	return result;
+}
+
+void addToSphereGroup(struct SphereGroup *group, struct Sphere *sphere, struct Material *material) {
+	if(group->count >= SPHERE_GROUP_WIDTH)
+		return;
+
+	float centerX[SPHERE_GROUP_WIDTH], centerY[SPHERE_GROUP_WIDTH], centerZ[SPHERE_GROUP_WIDTH], radius[SPHERE_GROUP_WIDTH];
+	vstoreG(group->centerX, 0, centerX);
+	vstoreG(group->centerY, 0, centerY);
+	vstoreG(group->centerZ, 0, centerZ);
+	vstoreG(group->radius, 0, radius);
+
+	int i = group->count++;
+	centerX[i] = sphere->center.x;
+	centerY[i] = sphere->center.y;
+	centerZ[i] = sphere->center.z;
+	radius[i] = sphere->radius;
+	group->materials[i] = material;
+
+	group->centerX = vloadG(0, centerX);
+	group->centerY = vloadG(0, centerY);
+	group->centerZ = vloadG(0, centerZ);
+	group->radius = vloadG(0, radius);
+}
+
+// tests ray against all spheres of the group at once, lane skipLane is left out (-1 tests all)
+struct HitTestResult testSphereGroup(struct SphereGroup *group, struct Ray *ray, int skipLane) {
+	struct HitTestResult result;
+	result.hit = false;
+
+#ifdef SCALAR_SPHERE_GROUPS
+	float centerX[SPHERE_GROUP_WIDTH], centerY[SPHERE_GROUP_WIDTH], centerZ[SPHERE_GROUP_WIDTH], radius[SPHERE_GROUP_WIDTH];
+	vstoreG(group->centerX, 0, centerX);
+	vstoreG(group->centerY, 0, centerY);
+	vstoreG(group->centerZ, 0, centerZ);
+	vstoreG(group->radius, 0, radius);
+
+	float minT = MAX;
+	for(int i = 0; i < group->count; i++) {
+		if(i == skipLane)
+			continue;
+		struct Sphere sphere = createSphere((float3)(centerX[i], centerY[i], centerZ[i]), radius[i]);
+		struct HitTestResult sphereResult = testSphere(&sphere, ray);
+		if(sphereResult.hit == true && sphereResult.t < minT) {
+			minT = sphereResult.t;
+			result = sphereResult;
+			result.lane = i;
+		}
+	}
+	return result;
+#else
+	floatG distanceX = ray->origin.x - group->centerX;
+	floatG distanceY = ray->origin.y - group->centerY;
+	floatG distanceZ = ray->origin.z - group->centerZ;
+
+	float a = dot(ray->direction, ray->direction);
+	floatG b = 2*(distanceX*ray->direction.x + distanceY*ray->direction.y + distanceZ*ray->direction.z);
+	floatG c = distanceX*distanceX + distanceY*distanceY + distanceZ*distanceZ - group->radius*group->radius;
+	floatG delta = b*b - 4*a*c;
+	floatG root = sqrt(max(delta, (floatG)(0)));
+
+	float denominator = 2*a;
+	floatG tNear = (-b - root)/denominator;
+	floatG tFar = (-b + root)/denominator;
+	floatG t = select(tNear, tFar, tNear < (float)EPS);
+
+	intG valid = (delta >= 0) & (t >= (float)EPS) & (SPHERE_GROUP_LANES < group->count) & (SPHERE_GROUP_LANES != skipLane);
+	t = select((floatG)((float)MAX), t, valid);
+
+	// nearest lane is reduced in registers, each step keeps the closer half, lower lane on ties
+	intG lanes = SPHERE_GROUP_LANES;
+#if SPHERE_GROUP_WIDTH == 8
+	int4 closer4 = t.hi < t.lo;
+	float4 t4 = select(t.lo, t.hi, closer4);
+	int4 lane4 = select(lanes.lo, lanes.hi, closer4);
+	float4 centerX4 = select(group->centerX.lo, group->centerX.hi, closer4);
+	float4 centerY4 = select(group->centerY.lo, group->centerY.hi, closer4);
+	float4 centerZ4 = select(group->centerZ.lo, group->centerZ.hi, closer4);
+#else
+	float4 t4 = t;
+	int4 lane4 = lanes;
+	float4 centerX4 = group->centerX;
+	float4 centerY4 = group->centerY;
+	float4 centerZ4 = group->centerZ;
+#endif
+	int2 closer2 = t4.hi < t4.lo;
+	float2 t2 = select(t4.lo, t4.hi, closer2);
+	int2 lane2 = select(lane4.lo, lane4.hi, closer2);
+	float2 centerX2 = select(centerX4.lo, centerX4.hi, closer2);
+	float2 centerY2 = select(centerY4.lo, centerY4.hi, closer2);
+	float2 centerZ2 = select(centerZ4.lo, centerZ4.hi, closer2);
+
+	bool closer = t2.y < t2.x;
+	float minT = closer ? t2.y : t2.x;
+	if(minT >= (float)MAX)
+		return result;
+	float3 center = closer ? (float3)(centerX2.y, centerY2.y, centerZ2.y) : (float3)(centerX2.x, centerY2.x, centerZ2.x);
+
+	result.hit = true;
+	result.t = minT;
+	result.normal = normalize(ray->origin + ray->direction*minT - center);
+	result.lane = closer ? lane2.y : lane2.x;
+	return result;
+#endif
+}
+
 struct Plane {
 	float3 point;
 	float3 normal;
@@ -165,12 +338,14 @@ struct HitTestResult testPlane(struct Plane *plane, struct Ray *ray) {
 	result.hit = true;
 	result.t = t;
 	result.normal = plane->normal;
+	result.lane = -1;
 	return result;
 }
 
 enum OBJECT_TYPE {
 	SPHERE,
-	PLANE
+	PLANE,
+	SPHERE_GROUP
 };
 
 struct Object {
@@ -187,18 +362,62 @@ struct Object createObject(struct Material *material, int type, void *object) {
 	return result;
 }
 
-struct HitTestResult testObject(struct Object *obj, struct Ray *ray) {
+struct HitTestResult testObject(struct Object *obj, struct Ray *ray, int skipLane) {
 	struct HitTestResult result;
 	result.hit = false;
 	
 	switch(obj->type) {
 		case SPHERE	:	result = testSphere((struct Sphere*)(obj->object), ray);break;
 		case PLANE	:	result = testPlane((struct Plane*)(obj->object), ray);break;
+		case SPHERE_GROUP	:	result = testSphereGroup((struct SphereGroup*)(obj->object), ray, skipLane);break;
 	}
 	return result;
 }
 
-bool isAnyObstacleBetween(struct Scene *scene, struct Object *obj, float3 p1, float3 p2) {
+struct Material *getObjectMaterial(struct Object *obj, int lane) {
+	if(obj->type == SPHERE_GROUP)
+		return ((struct SphereGroup*)(obj->object))->materials[lane];
+	else
+		return obj->material;
+}
+
+// ====================================== INSTANCES ======================================//
+struct Instance {
+	float transform[16];	// world to object space
+	int object;
+	int material;	// index into scene materials, -1 keeps object material
+	int padding[2];
+};
+
+struct HitTestResult testInstance(struct Scene *scene, int instance, struct Ray *ray, int skipLane) {
+	struct HitTestResult result;
+	result.hit = false;
+
+	__global struct Instance *inst = &scene->instances[instance];
+	if(inst->object < 0 || inst->object >= scene->countObj)
+		return result;
+
+	// direction is not normalized, so t is the same in object and world space
+	struct Ray objectRay;
+	objectRay.origin = matrixByVector(inst->transform, &ray->origin);
+	objectRay.direction = matrixByDirection(inst->transform, &ray->direction);
+
+	result = testObject(scene->objects[inst->object], &objectRay, skipLane);
+	if(result.hit == true)
+		result.normal = normalize(transposedMatrixByDirection(inst->transform, &result.normal));
+	return result;
+}
+
+struct Material *getInstanceMaterial(struct Scene *scene, int instance, int lane) {
+	__global struct Instance *inst = &scene->instances[instance];
+	if(inst->material >= 0 && inst->material < scene->countMaterial)
+		return scene->materials[inst->material];
+	else
+		return getObjectMaterial(scene->objects[inst->object], lane);
+}
+
+bool isAnyObstacleBetween(struct Scene *scene, int instance, int lane, float3 p1, float3 p2) {
+	scene->rayCount++;
 	float3 vector = p2 - p1;
 	float dist = length(vector);
 
@@ -207,9 +426,16 @@ bool isAnyObstacleBetween(struct Scene *scene, struct Object *obj, float3 p1, fl
 	ray.direction = normalize(vector); 
 
 	struct HitTestResult result;
-	for(int i = 0; i < scene->countObj; i++) {
-		result = testObject(scene->objects[i], &ray);
-		if(result.hit == true && result.t < dist && scene->objects[i] != obj)
+	for(int i = 0; i < scene->countInstance; i++) {
+		if(i == instance) {
+			if(lane < 0)
+				continue;
+			result = testInstance(scene, i, &ray, lane);
+		}
+		else {
+			result = testInstance(scene, i, &ray, -1);
+		}
+		if(result.hit == true && result.t < dist)
 			return true;
 	}
 	return false;
@@ -238,7 +464,7 @@ float3 shadePerfectDiffuse(struct PerfectDiffuse *material, struct HitInfo *hitI
 		float3 direction = normalize(light->position-hitInfo->point);
 		float d = dot(direction, hitInfo->normal);
 
-		if(d >= 0 && !isAnyObstacleBetween(hitInfo->scene, hitInfo->object, light->position, hitInfo->point)) {
+		if(d >= 0 && !isAnyObstacleBetween(hitInfo->scene, hitInfo->instance, hitInfo->lane, light->position, hitInfo->point)) {
 			total += d*light->power*(float3)(light->color.x*material->color.x, light->color.y*material->color.y, light->color.z*material->color.z);
 		}
 	}
@@ -279,7 +505,7 @@ float3 shadePhong(struct Phong *material, struct HitInfo *hitInfo) {
 		float ln = dot(L, N);
 		float rv = dot(R, V);
 
-		if(ln >= 0 && !isAnyObstacleBetween(hitInfo->scene, hitInfo->object, light->position, hitInfo->point)) {
+		if(ln >= 0 && !isAnyObstacleBetween(hitInfo->scene, hitInfo->instance, hitInfo->lane, light->position, hitInfo->point)) {
 			float3 result = (ln*material->diffuse)*(float3)(light->color.x*material->color.x, light->color.y*material->color.y, light->color.z*material->color.z);
 			float phong;
 			if (rv <= 0) {
@@ -329,28 +555,45 @@ float3 shadeMaterial(struct Material *mat, struct HitInfo *hitInfo) {
 	return result;
 }
 
+float3 getMaterialAlbedo(struct Material *mat) {
+	float3 result = (float3)(0, 0, 0);
+
+	if(mat->type == PERFFECT_DIFFUSE) {
+		result = ((struct PerfectDiffuse*)(mat->material))->color;
+	}
+	else if(mat->type == PHONG) {
+		result = ((struct Phong*)(mat->material))->color;
+	}
+
+	return result;
+}
+
 // =================================== MAIN FUNCTIONS ==================================== //
 float3 shadeRay(struct HitInfo *hitInfo, int maxDepth) {
 	if(hitInfo->depth > maxDepth) {
 		return (float3)(0, 0, 0);
 	}
 	else {
-		return shadeMaterial(hitInfo->object->material, hitInfo);
+		return shadeMaterial(hitInfo->material, hitInfo);
 	}
 }
 
-float3 raytrace(struct Scene *scene, struct Ray *ray, int depth) {	
+float3 raytrace(struct Scene *scene, struct Ray *ray, int depth, struct Surface *surface) {	
 	struct HitInfo hitInfo;
 	float minT = MAX;
 	struct HitTestResult hitTestResult;
 
 	hitInfo.scene = scene;
 	hitInfo.ray = ray;
-	for(int i = 0; i < scene->countObj; i++) {
-		hitTestResult = testObject(scene->objects[i], ray);
+	scene->rayCount++;
+	for(int i = 0; i < scene->countInstance; i++) {
+		hitTestResult = testInstance(scene, i, ray, -1);
 		if(hitTestResult.hit == true && hitTestResult.t < minT) {
 			minT = hitTestResult.t;
-			hitInfo.object = scene->objects[i];
+			hitInfo.instance = i;
+			hitInfo.object = scene->objects[scene->instances[i].object];
+			hitInfo.lane = hitTestResult.lane;
+			hitInfo.material = getInstanceMaterial(scene, i, hitInfo.lane);
 			hitInfo.normal = hitTestResult.normal;
 			hitInfo.point = ray->origin + hitTestResult.t * ray->direction;
 			hitInfo.depth = depth+1;
@@ -358,15 +601,47 @@ float3 raytrace(struct Scene *scene, struct Ray *ray, int depth) {
 	}
 
 	if(minT == MAX) {
+		surface->albedo = BLUESKY;
+		surface->normal = (float3)(0, 0, 0);
+		surface->depth = MAX;
 		return BLUESKY;
 	}
 	else {
+		surface->albedo = getMaterialAlbedo(hitInfo.material);
+		surface->normal = hitInfo.normal;
+		surface->depth = minT*length(ray->direction);
 		return shadeRay(&hitInfo, 5);
 	}
 }
 
+// ==================================== INTERLEAVE ===================================== //
+// maps work item to the pixel traced in this phase: interleave 2 is a checkerboard,
+// 4 traces one pixel of every 2x2 block, returns false for work items outside the image
+bool interleavedPixel(int n, uint width, uint height, uint interleave, uint phase, int *px, int *py) {
+	if(interleave == 2) {
+		int perRow = (width + 1) / 2;
+		*py = n / perRow;
+		*px = 2*(n % perRow) + ((*py + phase) & 1);
+	}
+	else if(interleave == 4) {
+		int perRow = (width + 1) / 2;
+		*px = 2*(n % perRow) + (phase & 1);
+		*py = 2*(n / perRow) + (phase >> 1);
+	}
+	else {
+		*px = n % width;
+		*py = n / width;
+	}
+	return *px < width && *py < height;
+}
+
 // ====================================== KERNEL ======================================= //
-__kernel void main(__global float4 *output, uint width, uint height, float3 position, float3 lookAt, float3 up, uint samplerCount, __global float *sampler) {	
+__kernel void main(__global float4 *output, uint width, uint height, float3 position, float3 lookAt, float3 up, uint samplerCount, __global float *sampler, __global struct Instance *instances, uint instanceCount, __global float4 *albedo, __global float4 *normalDepth, __global uint *rayCount, uint interleave, uint phase) {	
+	int px, py;
+	if(!interleavedPixel(get_global_id(0), width, height, interleave, phase, &px, &py))
+		return;
+	int n = py*width + px;
+
 	// scene
 	struct Plane p1 = createPlane((float3)(0, 0, 0), (float3)(0, 1, 0));
 	struct PerfectDiffuse p1pd = createPerfectDiffuse(WHITE);
@@ -376,27 +651,56 @@ __kernel void main(__global float4 *output, uint width, uint height, float3 posi
 	struct Phong phong1 = createPhong(RED, 1, 4, 10);
 	struct Material material1 = createMaterial(PHONG, (void*)&phong1);
 	struct Sphere sphere1 = createSphere((float3)(-7, 3, -7), 3);
-	struct Object object1 = createObject(&material1, SPHERE, &sphere1);
 	struct Phong phong2 = createPhong(GREEN, 0.5, 10, 80);
 	struct Material material2 = createMaterial(PHONG, (void*)&phong2);
 	struct Sphere sphere2 = createSphere((float3)(-7, 3, 7), 3);
-	struct Object object2 = createObject(&material2, SPHERE, &sphere2);
 	struct Phong phong3 = createPhong(BLUE, 0.5, 10, 80);
 	struct Material material3 = createMaterial(PHONG, (void*)&phong3);
 	struct Sphere sphere3 = createSphere((float3)(7, 3, -7), 3);
-	struct Object object3 = createObject(&material3, SPHERE, &sphere3);
 	struct Phong phong4 = createPhong(WHITE, 0.5, 1, 10);
 	struct Material material4 = createMaterial(PHONG, (void*)&phong4);
 	struct Sphere sphere4 = createSphere((float3)(0, 1, 0), 1);
-	struct Object object4 = createObject(&material4, SPHERE, &sphere4);
 
+	struct SphereGroup spheres = createSphereGroup();
+	addToSphereGroup(&spheres, &sphere1, &material1);
+	addToSphereGroup(&spheres, &sphere2, &material2);
+	addToSphereGroup(&spheres, &sphere3, &material3);
+	addToSphereGroup(&spheres, &sphere4, &material4);
+	struct Object group = createObject(0, SPHERE_GROUP, &spheres);
+
+	struct Sphere unitSphere = createSphere((float3)(0, 0, 0), 1);
+	struct Object unit = createObject(&material4, SPHERE, &unitSphere);
+
+	struct Phong phong5 = createPhong(YELLOW, 0.8, 4, 20);
+	struct Material material5 = createMaterial(PHONG, (void*)&phong5);
+	struct Phong phong6 = createPhong(ORANGE, 0.8, 4, 20);
+	struct Material material6 = createMaterial(PHONG, (void*)&phong6);
+	struct Phong phong7 = createPhong(PINK, 0.8, 4, 20);
+	struct Material material7 = createMaterial(PHONG, (void*)&phong7);
+	struct Phong phong8 = createPhong(LIGHTGREEN, 0.8, 4, 20);
+	struct Material material8 = createMaterial(PHONG, (void*)&phong8);
+
+	// objects and materials are referenced by index from instances, keep in sync with main.cpp
 	struct Scene scene;
-	scene.countObj = 5;
+	scene.countObj = 3;
 	scene.objects[0] = &plane;
-	scene.objects[1] = &object1;
-	scene.objects[2] = &object2;
-	scene.objects[3] = &object3;
-	scene.objects[4] = &object4;
+	scene.objects[1] = &group;
+	scene.objects[2] = &unit;
+
+	scene.countMaterial = 9;
+	scene.materials[0] = &p1m;
+	scene.materials[1] = &material1;
+	scene.materials[2] = &material2;
+	scene.materials[3] = &material3;
+	scene.materials[4] = &material4;
+	scene.materials[5] = &material5;
+	scene.materials[6] = &material6;
+	scene.materials[7] = &material7;
+	scene.materials[8] = &material8;
+
+	scene.instances = instances;
+	scene.countInstance = instanceCount;
+	scene.rayCount = 0;
 
 	// lights
 	struct Light l1;
@@ -425,16 +729,30 @@ __kernel void main(__global float4 *output, uint width, uint height, float3 posi
 	float3 cameraY = cross(cameraZ, cameraX);
 
 	int minDimension = min(width, height);
-	int n = get_global_id(0);
 	struct Ray ray;
 	ray.origin = position;
 
-	output[get_global_id(0)] = (float4)(0, 0, 0, 0);
+	struct Surface surface;
+	float3 surfaceAlbedo = (float3)(0, 0, 0);
+	float3 surfaceNormal = (float3)(0, 0, 0);
+	float surfaceDepth = 0;
+
+	output[n] = (float4)(0, 0, 0, 0);
 	for(int i = 0; i < samplerCount; i++) {
-		float x = ((n % width) + sampler[2*i] - width * 0.5) / minDimension * 2;
-		float y = ((n / width) + sampler[2*i+1] - height * 0.5) / minDimension * 2;
+		float x = (px + sampler[2*i] - width * 0.5) / minDimension * 2;
+		float y = (py + sampler[2*i+1] - height * 0.5) / minDimension * 2;
 		ray.direction = cameraX*x + cameraY * y + cameraZ*1.8;
-		output[get_global_id(0)] += (float4)(raytrace(&scene, &ray, 0)/samplerCount, 1);
+		output[n] += (float4)(raytrace(&scene, &ray, 0, &surface)/samplerCount, 1);
+		surfaceAlbedo += surface.albedo/samplerCount;
+		surfaceNormal += surface.normal;
+		surfaceDepth = (i == 0 ? surface.depth : min(surfaceDepth, surface.depth));
 	}
-	output[get_global_id(0)].w = 1;
+	output[n].w = 1;
+
+	albedo[n] = (float4)(surfaceAlbedo, 1);
+	normalDepth[n] = (float4)(length(surfaceNormal) > 0 ? normalize(surfaceNormal) : surfaceNormal, surfaceDepth);
+
+	// optional, one atomic per work item
+	if(rayCount != 0)
+		atomic_add(rayCount, scene.rayCount);
 }
\ No newline at end of file
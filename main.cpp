@@ -28,7 +28,14 @@
 #pragma comment (lib, "SDL2.lib")
 #pragma comment (lib, "opengl32.lib")
 
+#include <vector>
+#include <sstream>
+
 #include "raytracer.h"
+#include "rendercontext.h"
+#include "batch.h"
+#include "regression.h"
+#include "benchmark.h"
 
 using namespace std;
 
@@ -41,22 +48,41 @@ const size_t AREA = WIDTH*HEIGHT;
 const char *TITLE = "Raytracer";
 const bool FULLSCREEN = false;
 const unsigned SAMPLES = 16;
+const unsigned LOW_SAMPLES = 2;	// used when denoise or temporal is on
+const float TARGET_FRAME_TIME = 16.6f;	// ms of device time, kept by dynamic resolution
+const float MIN_RESOLUTION_SCALE = 0.25f;
 SDL_Window *window;
 SDL_Renderer *renderer;
 OpenCLManager *manager;
-OpenCLKernel *kernel;
+RenderContext *context;
+bool framePending;	// one frame is rendered while the previous one is displayed
 
 CVector3D position, lookAt, up;
-float *sampler;
-cl_mem outputB;
-cl_mem samplerB;
+bool denoise;
+bool temporal;
+unsigned interleave;	// 1, 2 (checkerboard) or 4 pixels share one traced pixel per frame
 
 CVector3D xVec, yVec;
 int coefX, coefY;
 
+// internal resolution, context buffers are allocated once for the window size and reused for any smaller one
+bool dynamicResolution;
+float resolutionScale;
+unsigned dynamicSamples;
+unsigned char *pixels;
+
+// objects and materials defined in kernel.cl
+enum { PLANE_OBJECT, SPHERE_GROUP_OBJECT, UNIT_SPHERE_OBJECT };
+enum { YELLOW_MATERIAL = 5, ORANGE_MATERIAL, PINK_MATERIAL, LIGHTGREEN_MATERIAL };
+
 // FUNCTIONS
+vector<SceneInstance> createScene();
+bool hasArgument(int argc, char* argv[], const string &name);
+string argumentValue(int argc, char* argv[], const string &name);
+string kernelOptions(int argc, char* argv[]);
 void update(float dt);
 void render();
+void updateResolution(double frameTime);
 
 // MAIN FUNCTION
 #ifdef main
@@ -72,10 +98,55 @@ int main(int argc, char* argv[]) {
 	cout << "|                                                          |" << endl;
 	cout << "\\----------------------------------------------------------/" << endl << endl << endl << endl;
 
+	// host math only, no device needed
+	if (argc >= 2 && string(argv[1]) == "--bench-math") {
+		Benchmark::runMath();
+		return 0;
+	}
+
+	// --device <platform>:<device>, cpu or gpu skips the interactive choice
+	string device = argumentValue(argc, argv, "--device");
+	if (!device.empty() && !Raytracer::isOpenCLDevice(device)) {
+		cout << "Invalid device '" << device << "'!" << endl;
+		return 1;
+	}
+
+	// regression mode compares reference scenes on a CPU device by default, so nothing is asked
+	if (argc >= 3 && string(argv[1]) == "--regression") {
+		manager = Raytracer::createOpenCLManager(device.empty() ? "cpu" : device);
+		if (manager == NULL) {
+			cout << "OpenCLManager can't create!" << endl;
+			return 1;
+		}
+		bool result = Regression::run(manager, createScene(), argv[2], hasArgument(argc, argv, "--update"), kernelOptions(argc, argv));
+		delete manager;
+		return (result ? 0 : 1);
+	}
+
+	// batch mode renders a job file without window, device comes from command line or job file
+	if (argc >= 3 && string(argv[1]) == "--batch") {
+		BatchJob job;
+		if (!Batch::loadJob(argv[2], job))
+			return 1;
+		manager = Raytracer::createOpenCLManager(device.empty() ? job.device : device);
+		if (manager == NULL) {
+			cout << "OpenCLManager can't create!" << endl;
+			return 1;
+		}
+		bool result = Batch::run(manager, createScene(), job, kernelOptions(argc, argv));
+		delete manager;
+		return (result ? 0 : 1);
+	}
+
 	// opencl
-	cout << "-= CHOOSE PLATFORM/DEVICE =-" << endl;
-	manager = Raytracer::createOpenCLManager();
-	cout << endl << endl;
+	if (!device.empty()) {
+		manager = Raytracer::createOpenCLManager(device);
+	}
+	else {
+		cout << "-= CHOOSE PLATFORM/DEVICE =-" << endl;
+		manager = Raytracer::createOpenCLManager();
+		cout << endl << endl;
+	}
 
 	cout << "-= LOGS =-" << endl;
 	if (manager == NULL) {
@@ -83,17 +154,16 @@ int main(int argc, char* argv[]) {
 		system("pause");
 		return 1;
 	}
-	kernel = Raytracer::createOpenCLKernel(manager, "kernel.cl", "main");
-	if (kernel == NULL) {
-		cout << "OpenCLKernel can't create!" << endl;
-		system("pause");
-		return 1;
-	}
-	else if (kernel->isErrors()) {
-		cout << "Compiletion failed!" << endl << kernel->getBuildInfo() << endl;
+
+	context = Raytracer::createRenderContext(manager, WIDTH, HEIGHT, SAMPLES, kernelOptions(argc, argv));
+	if (context == NULL) {
+		cout << "RenderContext can't create!" << endl;
 		system("pause");
 		return 1;
 	}
+	context->setScene(createScene());
+	framePending = false;
+	cout << (context->isZeroCopy() ? "Zero-copy buffers (host unified memory)" : "Explicit buffer copies") << endl;
 
 	// sdl window
 	SDL_Init(SDL_INIT_EVERYTHING);
@@ -118,26 +188,13 @@ int main(int argc, char* argv[]) {
 	up = CVector3D(0, 1, 0);
 	xVec = yVec = CVector3D(0, 0, 0);
 	coefX = coefY = 0;
-	sampler = new float[2 * SAMPLES];
-	for (int i = 0; i < SAMPLES; i++) {
-		sampler[2 * i] = (rand() % 10)/10.0;
-		sampler[2 * i + 1] = (rand() % 10) / 10.0;
-	}
-
-	cl_int error = CL_SUCCESS;
-	outputB = clCreateBuffer(manager->getContext(), CL_MEM_WRITE_ONLY, AREA*sizeof(cl_float4), NULL, &error);
-	if (error != CL_SUCCESS) {
-		cout << "Buffer can't create!" << endl;
-		system("pause");
-		return 1;
-	}
-
-	samplerB = clCreateBuffer(manager->getContext(), CL_MEM_WRITE_ONLY, 2*SAMPLES*sizeof(cl_float), NULL, &error);
-	if (error != CL_SUCCESS) {
-		cout << "Buffer can't create!" << endl;
-		system("pause");
-		return 1;
-	}
+	denoise = false;
+	temporal = false;
+	interleave = 1;
+	dynamicResolution = false;
+	resolutionScale = 1;
+	dynamicSamples = SAMPLES;
+	pixels = new unsigned char[AREA * 4];
 
 	// main loop
 	float dt;
@@ -160,6 +217,10 @@ int main(int argc, char* argv[]) {
 					case SDLK_RIGHT:	coefX = -1;break;
 					case SDLK_UP:		coefY = 1; break;
 					case SDLK_DOWN:		coefY = -1;break;
+					case SDLK_f:		denoise = !denoise;break;
+					case SDLK_t:		temporal = !temporal;break;
+					case SDLK_c:		interleave = (interleave == 4 ? 1 : interleave * 2);break;
+					case SDLK_r:		dynamicResolution = !dynamicResolution; updateResolution(TARGET_FRAME_TIME);break;
 					default:			break;
 				}
 			}
@@ -196,23 +257,55 @@ int main(int argc, char* argv[]) {
 		render();
 	}
 
-	if(clReleaseMemObject(outputB) != CL_SUCCESS) {
-		cout << "Can't release mem object: outputB!" << endl;
-		system("pause");
-		return 1;
-	}
-	if (clReleaseMemObject(samplerB) != CL_SUCCESS) {
-		cout << "Can't release mem object: outputB!" << endl;
-		system("pause");
-		return 1;
-	}
+	delete context;
 	delete manager;
-	delete kernel;
+	delete[] pixels;
 	SDL_ShowCursor(1);
 	SDL_Quit();
 	return 0;
 }
 
+bool hasArgument(int argc, char* argv[], const string &name) {
+	for (int i = 1; i < argc; i++)
+		if (name == argv[i])
+			return true;
+	return false;
+}
+
+string argumentValue(int argc, char* argv[], const string &name) {
+	for (int i = 1; i + 1 < argc; i++)
+		if (name == argv[i])
+			return argv[i + 1];
+	return "";
+}
+
+// --scalar-groups and --group-width <4|8> select the sphere group path of kernel.cl
+string kernelOptions(int argc, char* argv[]) {
+	ostringstream options;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--scalar-groups")
+			options << " -D SCALAR_SPHERE_GROUPS";
+		else if (string(argv[i]) == "--group-width" && i + 1 < argc)
+			options << " -D SPHERE_GROUP_WIDTH=" << (string(argv[++i]) == "8" ? 8 : 4);
+	}
+	return options.str();
+}
+
+vector<SceneInstance> createScene() {
+	vector<SceneInstance> instances;
+	instances.push_back(Raytracer::createSceneInstance(PLANE_OBJECT, CMatrix4x4()));
+	instances.push_back(Raytracer::createSceneInstance(SPHERE_GROUP_OBJECT, CMatrix4x4()));
+
+	// ring of small spheres sharing one geometry
+	const int ring = 24;
+	for (int i = 0; i < ring; i++) {
+		float angle = 2 * PI * i / ring;
+		CVector3D center(14 * cos(angle), 0.6f, 14 * sin(angle));
+		instances.push_back(Raytracer::createSceneInstance(UNIT_SPHERE_OBJECT, CMatrix4x4::translation(center) * CMatrix4x4::scaling(0.6f), YELLOW_MATERIAL + i % 4));
+	}
+	return instances;
+}
+
 void update(float dt) {
 	if (coefX != 0)
 		position += coefX*xVec*dt*0.0003f;
@@ -221,78 +314,55 @@ void update(float dt) {
 }
 
 void render() {
-	float pos[] = { position.x, position.y, position.z }; 
-	float la[] = { position.x + lookAt.x, position.y + lookAt.y, position.z + lookAt.z };
-	float u[] = { up.x, up.y, up.z };
-
-	if (clSetKernelArg(kernel->getKernel(), 0, sizeof(outputB), (void*)&outputB) != CL_SUCCESS) {
-		cout << "Set kernel arg: outputB!" << endl;
-		system("pause");
-		exit(1);
-	}
-	if (clSetKernelArg(kernel->getKernel(), 1, sizeof(cl_uint), (void*)&WIDTH) != CL_SUCCESS) {
-		cout << "Set kernel arg: WIDTH!" << endl;
-		system("pause");
-		exit(1);
-	}
-	if (clSetKernelArg(kernel->getKernel(), 2, sizeof(cl_uint), (void*)&HEIGHT) != CL_SUCCESS) {
-		cout << "Set kernel arg: HEIGHT!" << endl;
-		system("pause");
-		exit(1);
-	}
-	if (clSetKernelArg(kernel->getKernel(), 3, sizeof(cl_float3), (void*)&pos) != CL_SUCCESS) {
-		cout << "Set kernel arg: HEIGHT!" << endl;
-		system("pause");
-		exit(1);
-	}
-	if (clSetKernelArg(kernel->getKernel(), 4, sizeof(cl_float3), (void*)&la) != CL_SUCCESS) {
-		cout << "Set kernel arg: HEIGHT!" << endl;
-		system("pause");
-		exit(1);
-	}
-	if(clSetKernelArg(kernel->getKernel(), 5, sizeof(cl_float3), (void*)&up) != CL_SUCCESS) {
-		cout << "Set kernel arg: HEIGHT!" << endl;
-		system("pause");
-		exit(1);
-	}
-	if (clSetKernelArg(kernel->getKernel(), 6, sizeof(cl_uint), (void*)&SAMPLES) != CL_SUCCESS) {
-		cout << "Set kernel arg: samplerCount!" << endl;
-		system("pause");
-		exit(1);
-	}
-	if (clSetKernelArg(kernel->getKernel(), 7, sizeof(samplerB), (void*)&samplerB) != CL_SUCCESS) {
-		cout << "Set kernel arg: sampler!" << endl;
+	unsigned samples = (dynamicResolution ? dynamicSamples : SAMPLES);
+	if (denoise || temporal)
+		samples = min(samples, LOW_SAMPLES);
+	context->setCamera(position, position + lookAt, up);
+	context->setSamples(samples);
+	context->setDenoise(denoise);
+	context->setTemporal(temporal);
+	context->setInterleave(interleave);
+	if (!context->renderAsync()) {
 		system("pause");
 		exit(1);
 	}
 
-	cl_float *ptrSampler = (cl_float*)clEnqueueMapBuffer(manager->getQueue(), samplerB, CL_TRUE, CL_MAP_WRITE, 0, 2*SAMPLES * sizeof(cl_float), 0, NULL, NULL, NULL);
-	memcpy(ptrSampler, sampler, sizeof(float)*2*SAMPLES);
-	clEnqueueUnmapMemObject(manager->getQueue(), samplerB, ptrSampler, 0, 0, 0);
-
-
-	cl_int error = CL_SUCCESS;
-	error = clEnqueueNDRangeKernel(manager->getQueue(), kernel->getKernel(), 1, NULL, &AREA, NULL, 0, NULL, NULL);
-	if(error != CL_SUCCESS) {
-		cout << "clEnqueueNDRangeKernel!: " << error << endl;
-		system("pause");
-		exit(1);
+	// first frame is only enqueued, later ones show the frame enqueued before
+	if (!framePending) {
+		framePending = true;
+		return;
 	}
-
-	cl_float4 *ptrOutput = (cl_float4*)clEnqueueMapBuffer(manager->getQueue(), outputB, CL_TRUE, CL_MAP_READ, 0, AREA * sizeof(cl_float4), 0, NULL, NULL, &error);
-	if (error != CL_SUCCESS) {
-		cout << "clEnqueueMapBuffer!" << endl;
+	RenderFrame frame;
+	if (!context->readback(frame)) {
 		system("pause");
 		exit(1);
 	}
 
-	unsigned char *output = new unsigned char[AREA * 4];
-	for (int i = 0; i < AREA; i++) {
-		output[i * 4] = (unsigned char)(ptrOutput[i].s[0] * 255);
-		output[i * 4 + 1] = (unsigned char)(ptrOutput[i].s[1] * 255);
-		output[i * 4 + 2] = (unsigned char)(ptrOutput[i].s[2] * 255);
-		output[i * 4 + 3] = (unsigned char)255;
+	size_t area = frame.width * frame.height;
+	for (size_t i = 0; i < area; i++) {
+		pixels[i * 4] = (unsigned char)(frame.pixels[i].s[0] * 255);
+		pixels[i * 4 + 1] = (unsigned char)(frame.pixels[i].s[1] * 255);
+		pixels[i * 4 + 2] = (unsigned char)(frame.pixels[i].s[2] * 255);
+		pixels[i * 4 + 3] = (unsigned char)255;
 	}
+
+	// render and filter times are reported separately
+	ostringstream title;
+	title.precision(1);
+	title << fixed << "RayTracerGPU v1.0 | render: " << frame.renderTime << " ms";
+	if (frame.reconstructTime > 0)
+		title << " | 1/" << context->getInterleave() << " pixels, reconstruct: " << frame.reconstructTime << " ms";
+	if (frame.reprojectTime > 0)
+		title << " | temporal: " << frame.reprojectTime << " ms";
+	if (frame.denoiseTime > 0)
+		title << " | denoise: " << frame.denoiseTime << " ms";
+	title << " | copied: " << frame.copiedBytes / 1024.0 << " kB";
+	if (dynamicResolution)
+		title << " | " << frame.width << "x" << frame.height << ", " << context->getSamples() << " spp";
+	SDL_SetWindowTitle(window, title.str().c_str());
+
+	if (dynamicResolution)
+		updateResolution(frame.renderTime + frame.reconstructTime + frame.reprojectTime + frame.denoiseTime);
 	glEnable(GL_TEXTURE_2D);
 
 	GLuint texture = 0;
@@ -300,9 +370,7 @@ void render() {
 	glBindTexture(GL_TEXTURE_2D, texture);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, WIDTH, HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, output);
-
-	delete[] output;
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame.width, frame.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 
 	glClearColor(1.0f, 1.0f, 0.0f, 0.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -327,10 +395,31 @@ void render() {
 
 	SDL_RenderPresent(renderer);
 	SDL_GL_SwapWindow(window);
-	if(clFinish(manager->getQueue()) != CL_SUCCESS) {
-		cout << "clFinish!" << endl;
-		system("pause");
-		exit(1);
-	}
 	glDeleteTextures(1, &texture);
 }
+
+// resolution follows square root of the time ratio because cost grows with the pixel count,
+// sample count is only changed once resolution hits its limits
+void updateResolution(double frameTime) {
+	float scale = 1;
+	unsigned samples = SAMPLES;
+	if (dynamicResolution) {
+		double ratio = TARGET_FRAME_TIME / max(frameTime, 0.01);
+		scale = resolutionScale;
+		samples = dynamicSamples;
+		if (ratio < 0.9 || ratio > 1.1) {
+			scale = max(MIN_RESOLUTION_SCALE, min(1.0f, (float)(resolutionScale * sqrt(ratio))));
+			scale = floor(scale * 20 + 0.5f) / 20;
+			if (ratio < 0.9 && scale == MIN_RESOLUTION_SCALE && samples > 1)
+				samples--;
+			else if (ratio > 1.1 && scale == 1 && samples < SAMPLES)
+				samples++;
+		}
+	}
+
+	dynamicSamples = samples;
+	if (scale == resolutionScale)
+		return;
+	resolutionScale = scale;
+	context->setResolution(max(1u, (unsigned)(WIDTH * scale)), max(1u, (unsigned)(HEIGHT * scale)));
+}
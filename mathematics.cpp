@@ -24,7 +24,7 @@ using namespace std;
 
 const CVector3D CVector3D::ZERO = CVector3D(0, 0, 0);
 
-float *createLookAtLH(const CVector3D &position, const CVector3D &lookAt, const CVector3D &up) {
+CMatrix4x4 createLookAtLH(const CVector3D &position, const CVector3D &lookAt, const CVector3D &up) {
 	CVector3D z = CVector3D::normalize(lookAt - position);
 	CVector3D x = CVector3D::normalize(CVector3D::cross(up, z));
 	CVector3D y = -CVector3D::cross(z, x);
@@ -33,63 +33,37 @@ float *createLookAtLH(const CVector3D &position, const CVector3D &lookAt, const
 	float ydot = CVector3D::dot(y, position);
 	float zdot = CVector3D::dot(z, position);
 
-	float matrix[] = { x.x, y.x, z.x, 0,
+	return CMatrix4x4(x.x, y.x, z.x, 0,
 					  x.y, y.y, z.y, 0,
 					  x.z, y.z, z.z, 0,
-					  xdot, ydot, zdot, 1 };
-
-	float *result = new float[16];
-	for (int i = 0; i < 16; i++)
-		result[i] = matrix[i];
-	return result;
+					  xdot, ydot, zdot, 1);
 }
-float *createPerspective(float fovY, float aspect, float zn, float zf) {
+CMatrix4x4 createPerspective(float fovY, float aspect, float zn, float zf) {
 	float yScale = atan(fovY / 2);
 	float xScale = yScale / aspect;
-	float matrix[] = { xScale, 0, 0, 0,
-					   0, yScale, 0, 0,
-					   0, 0, zf/(zf-zn), 1,
-					   0, 0, -zn*zf/(zf-zn), 0};
-
-	float *result = new float[16];
-	for (int i = 0; i < 16; i++)
-		result[i] = matrix[i];
-	return result;
-}
-
-CVector3D::CVector3D() {
-	CVector3D(0.0, 0.0, 0.0);
-}
-CVector3D::CVector3D(float x, float y, float z) {
-	this->x = x;
-	this->y = y;
-	this->z = z;
-}
-CVector3D::CVector3D(const CVector3D &vec) {
-	this->x = vec.x;
-	this->y = vec.y;
-	this->z = vec.z;
-}
-float CVector3D::length() const {
-	return sqrt(x*x + y*y + z*z);
-}
-float CVector3D::lengthSq() const {
-	return x*x + y*y + z*z;
-}
-CVector3D CVector3D::normalize(const CVector3D &vec) {
-	CVector3D result(vec);
-	float length = result.length();
-	result /= length;
-	return result;
-}
-float CVector3D::dot(const CVector3D &v1, const CVector3D &v2) {
-	return v1.x*v2.x + v1.y*v2.y + v1.z*v2.z;
-}
-CVector3D CVector3D::cross(const CVector3D &v1, const CVector3D &v2) {
-	return CVector3D(v1.y*v2.z - v1.z*v2.y, v1.z * v2.x - v1.x*v2.z, v1.x*v2.y - v1.y*v2.x);
-}
-CVector3D CVector3D::reflect(const CVector3D &vector, const CVector3D &normal) {
-	return -vector + 2 * CVector3D::dot(normal, vector)*normal;
+	return CMatrix4x4(xScale, 0, 0, 0,
+					  0, yScale, 0, 0,
+					  0, 0, zf/(zf-zn), 1,
+					  0, 0, -zn*zf/(zf-zn), 0);
+}
+
+CMatrix4x4 CMatrix4x4::inverseAffine(const CMatrix4x4 &matrix) {
+	const float *m = matrix.data();
+	CVector3D a(m[0], m[1], m[2]);
+	CVector3D b(m[4], m[5], m[6]);
+	CVector3D c(m[8], m[9], m[10]);
+	CVector3D t(m[12], m[13], m[14]);
+
+	// rows of the inverted 3x3 part
+	float det = CVector3D::dot(a, CVector3D::cross(b, c));
+	CVector3D x = CVector3D::cross(b, c) / det;
+	CVector3D y = CVector3D::cross(c, a) / det;
+	CVector3D z = CVector3D::cross(a, b) / det;
+
+	return CMatrix4x4(x.x, y.x, z.x, 0,
+					  x.y, y.y, z.y, 0,
+					  x.z, y.z, z.z, 0,
+					  -CVector3D::dot(x, t), -CVector3D::dot(y, t), -CVector3D::dot(z, t), 1);
 }
 CVector3D CVector3D::rotate(const CVector3D &vector, float angle, const CVector3D &rotationVec) {
 	float c = cos(angle);
@@ -114,52 +88,3 @@ CVector3D CVector3D::rotate(const CVector3D &vector, float angle, const CVector3
 	result.z = matrix[2][0] * vector.x + matrix[2][1] * vector.y + matrix[2][2] * vector.z;
 	return result;
 }
-CVector3D &CVector3D::operator+=(const CVector3D &vector) {
-	x += vector.x;
-	y += vector.y;
-	z += vector.z;
-	return *this;
-}
-CVector3D &CVector3D::operator-=(const CVector3D &vector) {
-	x -= vector.x;
-	y -= vector.y;
-	z -= vector.z;
-	return *this;
-}
-CVector3D &CVector3D::operator*=(float coef) {
-	x *= coef;
-	y *= coef;
-	z *= coef;
-	return *this;
-}
-CVector3D &CVector3D::operator/=(float coef) {
-	x /= coef;
-	y /= coef;
-	z /= coef;
-	return *this;
-}
-
-CVector3D operator+(const CVector3D &v1, const CVector3D &v2) {
-	return CVector3D(v1.x + v2.x, v1.y + v2.y, v1.z + v2.z);
-}
-CVector3D operator-(const CVector3D &v1, const CVector3D &v2) {
-	return CVector3D(v1.x - v2.x, v1.y - v2.y, v1.z - v2.z);
-}
-CVector3D operator-(const CVector3D &vector) {
-	return CVector3D(-vector.x, -vector.y, -vector.z);
-}
-CVector3D operator*(const CVector3D &vector, float coef) {
-	return CVector3D(coef*vector.x, coef*vector.y, coef*vector.z);
-}
-CVector3D operator*(float coef, const CVector3D &vector) {
-	return CVector3D(coef*vector.x, coef*vector.y, coef*vector.z);
-}
-CVector3D operator/(const CVector3D &vector, float coef) {
-	return CVector3D(vector.x / coef, vector.y / coef, vector.z / coef);
-}
-bool operator==(const CVector3D &v1, const CVector3D &v2) {
-	return (v1.x == v2.x && v1.y == v2.y && v1.z == v2.z);
-}
-bool operator!=(const CVector3D &v1, const CVector3D &v2) {
-	return !(v1 == v2);
-}
\ No newline at end of file
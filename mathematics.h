@@ -23,43 +23,253 @@
 
 #include <cmath>
 
-class CVector3D {
+#if !defined(RAYTRACER_NO_SSE) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define RAYTRACER_SSE
+	#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+	#define RAYTRACER_ALIGN(n) __declspec(align(n))
+	#define RAYTRACER_INLINE __forceinline
+#else
+	#define RAYTRACER_ALIGN(n) __attribute__((aligned(n)))
+	#define RAYTRACER_INLINE inline __attribute__((always_inline))
+#endif
+
+// 16-byte vector, w is always 0 so it can be passed directly as cl_float3
+class RAYTRACER_ALIGN(16) CVector3D {
 	public:
-		float x, y, z;
+		union {
+			struct {
+				float x, y, z, w;
+			};
+#ifdef RAYTRACER_SSE
+			__m128 m;
+#endif
+		};
 
-		CVector3D();
-		CVector3D(float x, float y, float z);
-		CVector3D(const CVector3D &vec);
+		RAYTRACER_INLINE CVector3D() {
+#ifdef RAYTRACER_SSE
+			m = _mm_setzero_ps();
+#else
+			x = y = z = w = 0;
+#endif
+		}
+		RAYTRACER_INLINE CVector3D(float x, float y, float z) {
+#ifdef RAYTRACER_SSE
+			m = _mm_setr_ps(x, y, z, 0);
+#else
+			this->x = x;
+			this->y = y;
+			this->z = z;
+			this->w = 0;
+#endif
+		}
+#ifdef RAYTRACER_SSE
+		explicit RAYTRACER_INLINE CVector3D(__m128 m) {
+			this->m = m;
+		}
+#endif
 
-		float length() const;
-		float lengthSq() const;
+		RAYTRACER_INLINE float length() const {
+			return sqrt(lengthSq());
+		}
+		RAYTRACER_INLINE float lengthSq() const {
+			return dot(*this, *this);
+		}
 
-		static CVector3D normalize(const CVector3D &vec);
-		static float dot(const CVector3D &v1, const CVector3D &v2);
-		static CVector3D cross(const CVector3D &v1, const CVector3D &v2);
-		static CVector3D reflect(const CVector3D &vector, const CVector3D &normal);
+		static RAYTRACER_INLINE CVector3D normalize(const CVector3D &vec) {
+			return vec / vec.length();
+		}
+		static RAYTRACER_INLINE float dot(const CVector3D &v1, const CVector3D &v2) {
+#ifdef RAYTRACER_SSE
+			__m128 product = _mm_mul_ps(v1.m, v2.m);
+			__m128 shuffled = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 3, 0, 1));
+			__m128 sum = _mm_add_ps(product, shuffled);
+			shuffled = _mm_movehl_ps(shuffled, sum);
+			return _mm_cvtss_f32(_mm_add_ss(sum, shuffled));
+#else
+			return v1.x*v2.x + v1.y*v2.y + v1.z*v2.z;
+#endif
+		}
+		static RAYTRACER_INLINE CVector3D cross(const CVector3D &v1, const CVector3D &v2) {
+#ifdef RAYTRACER_SSE
+			__m128 a = _mm_mul_ps(_mm_shuffle_ps(v1.m, v1.m, _MM_SHUFFLE(3, 0, 2, 1)), _mm_shuffle_ps(v2.m, v2.m, _MM_SHUFFLE(3, 1, 0, 2)));
+			__m128 b = _mm_mul_ps(_mm_shuffle_ps(v1.m, v1.m, _MM_SHUFFLE(3, 1, 0, 2)), _mm_shuffle_ps(v2.m, v2.m, _MM_SHUFFLE(3, 0, 2, 1)));
+			return CVector3D(_mm_sub_ps(a, b));
+#else
+			return CVector3D(v1.y*v2.z - v1.z*v2.y, v1.z * v2.x - v1.x*v2.z, v1.x*v2.y - v1.y*v2.x);
+#endif
+		}
+		static RAYTRACER_INLINE CVector3D reflect(const CVector3D &vector, const CVector3D &normal) {
+			return -vector + 2 * CVector3D::dot(normal, vector)*normal;
+		}
 		static CVector3D rotate(const CVector3D &vector, float angle, const CVector3D &rotationVec);
 
-		CVector3D &operator+=(const CVector3D &vector);
-		CVector3D &operator-=(const CVector3D &vector);
-		CVector3D &operator*=(float coef);
-		CVector3D &operator/=(float coef);
+		RAYTRACER_INLINE CVector3D &operator+=(const CVector3D &vector) {
+			return *this = *this + vector;
+		}
+		RAYTRACER_INLINE CVector3D &operator-=(const CVector3D &vector) {
+			return *this = *this - vector;
+		}
+		RAYTRACER_INLINE CVector3D &operator*=(float coef) {
+			return *this = *this * coef;
+		}
+		RAYTRACER_INLINE CVector3D &operator/=(float coef) {
+			return *this = *this / coef;
+		}
 
-		friend CVector3D operator+(const CVector3D &v1, const CVector3D &v2);
-		friend CVector3D operator-(const CVector3D &v1, const CVector3D &v2);
-		friend CVector3D operator-(const CVector3D &vector);
-		friend CVector3D operator*(const CVector3D &vector, float coef); 
-		friend CVector3D operator*(float coef, const CVector3D &vector);
-		friend CVector3D operator/(const CVector3D &vector, float coef);
-		friend bool operator==(const CVector3D &v1, const CVector3D &v2);
-		friend bool operator!=(const CVector3D &v1, const CVector3D &v2);
+		friend RAYTRACER_INLINE CVector3D operator+(const CVector3D &v1, const CVector3D &v2) {
+#ifdef RAYTRACER_SSE
+			return CVector3D(_mm_add_ps(v1.m, v2.m));
+#else
+			return CVector3D(v1.x + v2.x, v1.y + v2.y, v1.z + v2.z);
+#endif
+		}
+		friend RAYTRACER_INLINE CVector3D operator-(const CVector3D &v1, const CVector3D &v2) {
+#ifdef RAYTRACER_SSE
+			return CVector3D(_mm_sub_ps(v1.m, v2.m));
+#else
+			return CVector3D(v1.x - v2.x, v1.y - v2.y, v1.z - v2.z);
+#endif
+		}
+		friend RAYTRACER_INLINE CVector3D operator-(const CVector3D &vector) {
+#ifdef RAYTRACER_SSE
+			return CVector3D(_mm_sub_ps(_mm_setzero_ps(), vector.m));
+#else
+			return CVector3D(-vector.x, -vector.y, -vector.z);
+#endif
+		}
+		friend RAYTRACER_INLINE CVector3D operator*(const CVector3D &vector, float coef) {
+#ifdef RAYTRACER_SSE
+			return CVector3D(_mm_mul_ps(vector.m, _mm_set1_ps(coef)));
+#else
+			return CVector3D(coef*vector.x, coef*vector.y, coef*vector.z);
+#endif
+		}
+		friend RAYTRACER_INLINE CVector3D operator*(float coef, const CVector3D &vector) {
+			return vector * coef;
+		}
+		friend RAYTRACER_INLINE CVector3D operator/(const CVector3D &vector, float coef) {
+#ifdef RAYTRACER_SSE
+			return CVector3D(_mm_div_ps(vector.m, _mm_setr_ps(coef, coef, coef, 1)));
+#else
+			return CVector3D(vector.x / coef, vector.y / coef, vector.z / coef);
+#endif
+		}
+		friend RAYTRACER_INLINE bool operator==(const CVector3D &v1, const CVector3D &v2) {
+#ifdef RAYTRACER_SSE
+			return (_mm_movemask_ps(_mm_cmpeq_ps(v1.m, v2.m)) & 7) == 7;
+#else
+			return (v1.x == v2.x && v1.y == v2.y && v1.z == v2.z);
+#endif
+		}
+		friend RAYTRACER_INLINE bool operator!=(const CVector3D &v1, const CVector3D &v2) {
+			return !(v1 == v2);
+		}
 
 	public:
 		static const CVector3D ZERO;
 };
 
+// column-major 4x4 matrix, same layout as matrixByVector in kernel.cl expects
+class RAYTRACER_ALIGN(16) CMatrix4x4 {
+	public:
+		union {
+			float m[16];
+#ifdef RAYTRACER_SSE
+			__m128 columns[4];
+#endif
+		};
+
+		RAYTRACER_INLINE CMatrix4x4() {
+			for (int i = 0; i < 16; i++)
+				m[i] = (i % 5 == 0 ? 1.0f : 0.0f);
+		}
+		RAYTRACER_INLINE CMatrix4x4(float m0, float m1, float m2, float m3,
+									float m4, float m5, float m6, float m7,
+									float m8, float m9, float m10, float m11,
+									float m12, float m13, float m14, float m15) {
+#ifdef RAYTRACER_SSE
+			columns[0] = _mm_setr_ps(m0, m1, m2, m3);
+			columns[1] = _mm_setr_ps(m4, m5, m6, m7);
+			columns[2] = _mm_setr_ps(m8, m9, m10, m11);
+			columns[3] = _mm_setr_ps(m12, m13, m14, m15);
+#else
+			m[0] = m0; m[1] = m1; m[2] = m2; m[3] = m3;
+			m[4] = m4; m[5] = m5; m[6] = m6; m[7] = m7;
+			m[8] = m8; m[9] = m9; m[10] = m10; m[11] = m11;
+			m[12] = m12; m[13] = m13; m[14] = m14; m[15] = m15;
+#endif
+		}
+
+		RAYTRACER_INLINE const float *data() const {
+			return m;
+		}
+
+		static RAYTRACER_INLINE CMatrix4x4 translation(const CVector3D &vector) {
+			return CMatrix4x4(1, 0, 0, 0,
+							  0, 1, 0, 0,
+							  0, 0, 1, 0,
+							  vector.x, vector.y, vector.z, 1);
+		}
+		static RAYTRACER_INLINE CMatrix4x4 scaling(float coef) {
+			return CMatrix4x4(coef, 0, 0, 0,
+							  0, coef, 0, 0,
+							  0, 0, coef, 0,
+							  0, 0, 0, 1);
+		}
+		static CMatrix4x4 inverseAffine(const CMatrix4x4 &matrix);
+
+		RAYTRACER_INLINE CVector3D transformPoint(const CVector3D &point) const {
+#ifdef RAYTRACER_SSE
+			__m128 result = _mm_add_ps(transform(point), columns[3]);
+			return CVector3D(_mm_and_ps(result, _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0))));
+#else
+			return CVector3D(m[0]*point.x + m[4]*point.y + m[8]*point.z + m[12],
+							 m[1]*point.x + m[5]*point.y + m[9]*point.z + m[13],
+							 m[2]*point.x + m[6]*point.y + m[10]*point.z + m[14]);
+#endif
+		}
+		RAYTRACER_INLINE CVector3D transformDirection(const CVector3D &direction) const {
+#ifdef RAYTRACER_SSE
+			return CVector3D(_mm_and_ps(transform(direction), _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0))));
+#else
+			return CVector3D(m[0]*direction.x + m[4]*direction.y + m[8]*direction.z,
+							 m[1]*direction.x + m[5]*direction.y + m[9]*direction.z,
+							 m[2]*direction.x + m[6]*direction.y + m[10]*direction.z);
+#endif
+		}
+
+		friend RAYTRACER_INLINE CMatrix4x4 operator*(const CMatrix4x4 &m1, const CMatrix4x4 &m2) {
+			CMatrix4x4 result;
+#ifdef RAYTRACER_SSE
+			for (int i = 0; i < 4; i++) {
+				__m128 column = _mm_mul_ps(m1.columns[0], _mm_set1_ps(m2.m[4*i]));
+				column = _mm_add_ps(column, _mm_mul_ps(m1.columns[1], _mm_set1_ps(m2.m[4*i + 1])));
+				column = _mm_add_ps(column, _mm_mul_ps(m1.columns[2], _mm_set1_ps(m2.m[4*i + 2])));
+				column = _mm_add_ps(column, _mm_mul_ps(m1.columns[3], _mm_set1_ps(m2.m[4*i + 3])));
+				result.columns[i] = column;
+			}
+#else
+			for (int i = 0; i < 4; i++)
+				for (int j = 0; j < 4; j++)
+					result.m[4*i + j] = m1.m[j]*m2.m[4*i] + m1.m[4 + j]*m2.m[4*i + 1] + m1.m[8 + j]*m2.m[4*i + 2] + m1.m[12 + j]*m2.m[4*i + 3];
+#endif
+			return result;
+		}
+
+	private:
+#ifdef RAYTRACER_SSE
+		RAYTRACER_INLINE __m128 transform(const CVector3D &vector) const {
+			__m128 result = _mm_mul_ps(columns[0], _mm_shuffle_ps(vector.m, vector.m, _MM_SHUFFLE(0, 0, 0, 0)));
+			result = _mm_add_ps(result, _mm_mul_ps(columns[1], _mm_shuffle_ps(vector.m, vector.m, _MM_SHUFFLE(1, 1, 1, 1))));
+			return _mm_add_ps(result, _mm_mul_ps(columns[2], _mm_shuffle_ps(vector.m, vector.m, _MM_SHUFFLE(2, 2, 2, 2))));
+		}
+#endif
+};
 
-float *createLookAtLH(const CVector3D &position, const CVector3D &lookAt, const CVector3D &up);
-float *createPerspective(float fov, float aspect, float zn, float zf);
+CMatrix4x4 createLookAtLH(const CVector3D &position, const CVector3D &lookAt, const CVector3D &up);
+CMatrix4x4 createPerspective(float fov, float aspect, float zn, float zf);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,212 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+// ======================================== CONST ======================================== //
+const __constant float SKY_DEPTH = 50000.0f;
+const __constant float NORMAL_EXPONENT = 64.0f;
+const __constant float DEPTH_PHI = 0.5f;
+const __constant float ALBEDO_PHI = 0.1f;
+
+// B3 spline
+const __constant float KERNEL_WEIGHTS[5] = { 1.0f/16, 1.0f/4, 3.0f/8, 1.0f/4, 1.0f/16 };
+
+// ====================================== DENOISE ====================================== //
+// one a-trous iteration, run with stepWidth 1, 2, 4, ... and colorPhi halved every time
+__kernel void denoise(__global float4 *input, __global float4 *output, __global float4 *albedo, __global float4 *normalDepth, uint width, uint height, int stepWidth, float colorPhi) {
+	int n = get_global_id(0);
+	if(n >= width*height)
+		return;
+
+	int x = n % width;
+	int y = n / width;
+
+	float4 color = input[n];
+	float3 normal = normalDepth[n].xyz;
+	float depth = normalDepth[n].w;
+	float3 surfaceAlbedo = albedo[n].xyz;
+
+	if(depth > SKY_DEPTH) {
+		output[n] = color;
+		return;
+	}
+
+	float3 sum = (float3)(0, 0, 0);
+	float weightSum = 0;
+	for(int dy = -2; dy <= 2; dy++) {
+		int qy = y + dy*stepWidth;
+		if(qy < 0 || qy >= height)
+			continue;
+		for(int dx = -2; dx <= 2; dx++) {
+			int qx = x + dx*stepWidth;
+			if(qx < 0 || qx >= width)
+				continue;
+
+			int q = qy*width + qx;
+			float3 c = input[q].xyz - color.xyz;
+			float3 a = albedo[q].xyz - surfaceAlbedo;
+			float4 nd = normalDepth[q];
+
+			float weight = KERNEL_WEIGHTS[dx + 2]*KERNEL_WEIGHTS[dy + 2];
+			weight *= exp(-dot(c, c)/colorPhi);
+			weight *= exp(-dot(a, a)/ALBEDO_PHI);
+			weight *= pow(max(0.0f, dot(nd.xyz, normal)), NORMAL_EXPONENT);
+			weight *= exp(-fabs(nd.w - depth)/(DEPTH_PHI*stepWidth));
+
+			sum += input[q].xyz*weight;
+			weightSum += weight;
+		}
+	}
+
+	output[n] = (weightSum > 0 ? (float4)(sum/weightSum, color.w) : color);
+}
+
+// ===================================== TEMPORAL ====================================== //
+const __constant float MAX_HISTORY = 16.0f;
+const __constant float DEPTH_TOLERANCE = 0.05f;
+const __constant float NORMAL_TOLERANCE = 0.9f;
+
+// same camera as main in kernel.cl, returns not normalized ray direction through pixel center
+float3 cameraRay(float3 position, float3 lookAt, float3 up, float px, float py, uint width, uint height) {
+	float3 cameraZ = normalize(lookAt - position);
+	float3 cameraX = normalize(cross(up, cameraZ));
+	float3 cameraY = cross(cameraZ, cameraX);
+
+	int minDimension = min(width, height);
+	float x = (px - width * 0.5f) / minDimension * 2;
+	float y = (py - height * 0.5f) / minDimension * 2;
+	return cameraX*x + cameraY*y + cameraZ*1.8f;
+}
+
+// inverse of cameraRay, returns false when vector is behind the camera or outside of the image
+bool cameraProject(float3 position, float3 lookAt, float3 up, float3 vector, uint width, uint height, int *px, int *py) {
+	float3 cameraZ = normalize(lookAt - position);
+	float3 cameraX = normalize(cross(up, cameraZ));
+	float3 cameraY = cross(cameraZ, cameraX);
+
+	float z = dot(vector, cameraZ);
+	if(z <= 0)
+		return false;
+
+	int minDimension = min(width, height);
+	float x = dot(vector, cameraX)*1.8f/z;
+	float y = dot(vector, cameraY)*1.8f/z;
+	*px = (int)floor(x*minDimension*0.5f + width*0.5f);
+	*py = (int)floor(y*minDimension*0.5f + height*0.5f);
+	return (*px >= 0 && *px < width && *py >= 0 && *py < height);
+}
+
+// blends color with previous history, w of history is the number of accumulated frames
+__kernel void reproject(__global float4 *color, __global float4 *history, __global float4 *newHistory, __global float4 *normalDepth, __global float4 *prevNormalDepth,
+						uint width, uint height, float3 position, float3 lookAt, float3 up, float3 prevPosition, float3 prevLookAt, float3 prevUp, int historyValid) {
+	int n = get_global_id(0);
+	if(n >= width*height)
+		return;
+
+	float4 current = color[n];
+	float4 nd = normalDepth[n];
+	bool sky = nd.w > SKY_DEPTH;
+
+	bool accepted = false;
+	int px, py;
+	if(historyValid) {
+		float3 direction = normalize(cameraRay(position, lookAt, up, n % width + 0.5f, n / width + 0.5f, width, height));
+
+		// sky is reprojected as a point at infinity
+		float3 vector = (sky ? direction : position + direction*nd.w - prevPosition);
+		if(cameraProject(prevPosition, prevLookAt, prevUp, vector, width, height, &px, &py)) {
+			float4 prev = prevNormalDepth[py*width + px];
+			if(sky) {
+				accepted = prev.w > SKY_DEPTH;
+			}
+			else {
+				float distance = length(vector);
+				accepted = fabs(prev.w - distance) < DEPTH_TOLERANCE*distance && dot(prev.xyz, nd.xyz) > NORMAL_TOLERANCE;
+			}
+		}
+	}
+
+	float4 result = (float4)(current.xyz, 1);
+	if(accepted) {
+		float4 prev = history[py*width + px];
+		float count = min(prev.w + 1, MAX_HISTORY);
+		result = (float4)(mix(prev.xyz, current.xyz, 1/count), count);
+	}
+
+	newHistory[n] = result;
+	color[n] = (float4)(result.xyz, current.w);
+}
+
+// ==================================== RECONSTRUCT ==================================== //
+// same pattern as interleavedPixel in kernel.cl
+bool isTraced(int x, int y, uint interleave, uint phase) {
+	if(interleave == 2)
+		return ((x + y + phase) & 1) == 0;
+	else if(interleave == 4)
+		return (x & 1) == (phase & 1) && (y & 1) == (phase >> 1);
+	return true;
+}
+
+// fills pixels not traced in this phase with their previous value clamped to the range of traced
+// neighbours, or with the neighbours average when there is no previous value, history holds the
+// last reconstructed image, geometry of untraced pixels is copied from one traced neighbour
+__kernel void reconstruct(__global float4 *color, __global float4 *albedo, __global float4 *normalDepth, __global float4 *history,
+						  uint width, uint height, uint interleave, uint phase, int historyValid) {
+	int n = get_global_id(0);
+	if(n >= width*height)
+		return;
+
+	int x = n % width;
+	int y = n / width;
+	if(isTraced(x, y, interleave, phase)) {
+		history[n] = color[n];
+		return;
+	}
+
+	float3 sum = (float3)(0, 0, 0);
+	float3 minColor = (float3)(MAXFLOAT, MAXFLOAT, MAXFLOAT);
+	float3 maxColor = (float3)(0, 0, 0);
+	int count = 0;
+	int source = -1;
+	for(int dy = -1; dy <= 1; dy++) {
+		for(int dx = -1; dx <= 1; dx++) {
+			int qx = x + dx;
+			int qy = y + dy;
+			if(qx < 0 || qx >= width || qy < 0 || qy >= height || !isTraced(qx, qy, interleave, phase))
+				continue;
+
+			int q = qy*width + qx;
+			float3 c = color[q].xyz;
+			sum += c;
+			minColor = min(minColor, c);
+			maxColor = max(maxColor, c);
+			if(source < 0)
+				source = q;
+			count++;
+		}
+	}
+	if(count == 0)
+		return;
+
+	float3 result = (historyValid ? clamp(history[n].xyz, minColor, maxColor) : sum/count);
+	color[n] = (float4)(result, 1);
+	history[n] = color[n];
+	albedo[n] = albedo[source];
+	normalDepth[n] = normalDepth[source];
+}
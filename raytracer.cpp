@@ -19,11 +19,15 @@
 */
 
 #include "raytracer.h"
+#include "rendercontext.h"
+#include <sstream>
 
 using namespace std;
 
 // OPENCLMANAGER
 OpenCLManager::~OpenCLManager() {
+	for (map<string, cl_program>::iterator i = programs.begin(); i != programs.end(); ++i)
+		clReleaseProgram(i->second);
 	clReleaseContext(context);
 	clReleaseCommandQueue(queue);
 }
@@ -39,36 +43,55 @@ cl_platform_id OpenCLManager::getPlatformId() const {
 cl_device_id OpenCLManager::getDeviceId() const {
 	return device;
 }
+bool OpenCLManager::isHostUnifiedMemory() const {
+	cl_bool unified = CL_FALSE;
+	if (clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &unified, NULL) != CL_SUCCESS)
+		return false;
+	return unified == CL_TRUE;
+}
 
 // OPENCLKERNEL
-bool OpenCLKernel::create(OpenCLManager *manager, std::string filename, std::string kernelName) {
+bool OpenCLKernel::create(OpenCLManager *manager, std::string filename, std::string kernelName, std::string options) {
 	cl_int error = CL_SUCCESS; 
 	logs = NULL;
 
 	program = NULL;
 	kernel = NULL;
-	ifstream file(filename.c_str(), std::ifstream::binary);
-	if (!file) {
-		cout << "Can't open file '" << filename << "'!" << endl;
-		return false;
-	}
-
-	string str(istreambuf_iterator<char>(file), (istreambuf_iterator<char>()));
-	const char* source = str.c_str();
-	size_t programSize = str.length();
-
-	program = clCreateProgramWithSource(manager->getContext(), 1, &source, &programSize, &error);
-	if (error != CL_SUCCESS) {
-		cout << "clCreateProgramWithSource: " << error << "!" << endl;
-		return false;
-	}
 
-	error = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-	if (error != CL_SUCCESS) {
-		size_t size;
-		clGetProgramBuildInfo(program, manager->getDeviceId(), CL_PROGRAM_BUILD_LOG, 0, NULL, &size);
-		logs = new char[size + 1];
-		clGetProgramBuildInfo(program, manager->getDeviceId(), CL_PROGRAM_BUILD_LOG, size + 1, logs, NULL);
+	// program is built once per manager, failed builds are not cached so every kernel gets its logs
+	string key = filename + "\n" + options;
+	lock_guard<mutex> lock(manager->programsMutex);
+	map<string, cl_program>::iterator cached = manager->programs.find(key);
+	if (cached != manager->programs.end()) {
+		program = cached->second;
+		clRetainProgram(program);
+	} else {
+		ifstream file(filename.c_str(), std::ifstream::binary);
+		if (!file) {
+			cout << "Can't open file '" << filename << "'!" << endl;
+			return false;
+		}
+
+		string str(istreambuf_iterator<char>(file), (istreambuf_iterator<char>()));
+		const char* source = str.c_str();
+		size_t programSize = str.length();
+
+		program = clCreateProgramWithSource(manager->getContext(), 1, &source, &programSize, &error);
+		if (error != CL_SUCCESS) {
+			cout << "clCreateProgramWithSource: " << error << "!" << endl;
+			return false;
+		}
+
+		error = clBuildProgram(program, 0, NULL, options.c_str(), NULL, NULL);
+		if (error != CL_SUCCESS) {
+			size_t size;
+			clGetProgramBuildInfo(program, manager->getDeviceId(), CL_PROGRAM_BUILD_LOG, 0, NULL, &size);
+			logs = new char[size + 1];
+			clGetProgramBuildInfo(program, manager->getDeviceId(), CL_PROGRAM_BUILD_LOG, size + 1, logs, NULL);
+		} else {
+			manager->programs[key] = program;
+			clRetainProgram(program);
+		}
 	}
 	kernel = clCreateKernel(program, kernelName.c_str(), &error);
 	if (error != CL_SUCCESS) {
@@ -194,7 +217,7 @@ OpenCLManager *Raytracer::createOpenCLManager() {
 	if (manager->context == NULL)
 		return NULL;
 
-	manager->queue = clCreateCommandQueue(manager->context, deviceIds[device], 0, &error);
+	manager->queue = clCreateCommandQueue(manager->context, deviceIds[device], CL_QUEUE_PROFILING_ENABLE, &error);
 	if (manager->queue == NULL)
 		return NULL;
 	manager->platform = platformIds[platform];
@@ -209,47 +232,126 @@ OpenCLManager *Raytracer::createOpenCLManager(char *filename) {
 	return NULL;
 }
 OpenCLManager *Raytracer::createOpenCLManager(unsigned platform, unsigned device) {
-	OpenCLManager *manager = new OpenCLManager();
-
-	cl_int error = CL_SUCCESS;
 	cl_uint platformNumber = 0;
 	cl_uint deviceNumber = 0;
 
 	// platforms
-	error = clGetPlatformIDs(0, NULL, &platformNumber);
-	if (platformNumber == 0) {
+	if (clGetPlatformIDs(0, NULL, &platformNumber) != CL_SUCCESS || platform >= platformNumber)
 		return NULL;
-	}
-
 	cl_platform_id* platformIds = new cl_platform_id[platformNumber];
-	error = clGetPlatformIDs(platformNumber, platformIds, NULL);
+	clGetPlatformIDs(platformNumber, platformIds, NULL);
+	cl_platform_id platformId = platformIds[platform];
+	delete[] platformIds;
 
-	// devices
-	error = clGetDeviceIDs(platformIds[platform], CL_DEVICE_TYPE_GPU, 0, NULL, &deviceNumber);
+	// devices, numbered like in the interactive choice
+	if (clGetDeviceIDs(platformId, CL_DEVICE_TYPE_GPU, 0, NULL, &deviceNumber) != CL_SUCCESS || device >= deviceNumber)
+		return NULL;
 	cl_device_id* deviceIds = new cl_device_id[deviceNumber];
-	error = clGetDeviceIDs(platformIds[0], CL_DEVICE_TYPE_GPU, deviceNumber, deviceIds, &deviceNumber);
+	clGetDeviceIDs(platformId, CL_DEVICE_TYPE_GPU, deviceNumber, deviceIds, NULL);
 
-	manager->context = clCreateContext(0, deviceNumber, deviceIds, NULL, NULL, NULL);
-	if (manager->context == NULL)
-		return false;
-
-	manager->queue = clCreateCommandQueue(manager->context, deviceIds[device], 0, &error);
-	manager->platform = platformIds[platform];
+	cl_int error = CL_SUCCESS;
+	OpenCLManager *manager = new OpenCLManager();
+	manager->queue = NULL;
+	manager->context = clCreateContext(0, deviceNumber, deviceIds, NULL, NULL, &error);
+	if (manager->context != NULL)
+		manager->queue = clCreateCommandQueue(manager->context, deviceIds[device], CL_QUEUE_PROFILING_ENABLE, &error);
+	manager->platform = platformId;
 	manager->device = deviceIds[device];
+	delete[] deviceIds;
 
+	if (manager->queue == NULL) {
+		delete manager;
+		return NULL;
+	}
+	return manager;
+}
+OpenCLManager *Raytracer::createOpenCLManager(cl_device_type type) {
+	cl_uint platformNumber = 0;
+	if (clGetPlatformIDs(0, NULL, &platformNumber) != CL_SUCCESS || platformNumber == 0)
+		return NULL;
+	cl_platform_id* platformIds = new cl_platform_id[platformNumber];
+	clGetPlatformIDs(platformNumber, platformIds, NULL);
+
+	cl_platform_id platform = NULL;
+	cl_device_id device = NULL;
+	for (cl_uint i = 0; i < platformNumber && device == NULL; i++) {
+		if (clGetDeviceIDs(platformIds[i], type, 1, &device, NULL) != CL_SUCCESS)
+			device = NULL;
+		platform = platformIds[i];
+	}
 	delete[] platformIds;
-	delete[] deviceIds;
+	if (device == NULL)
+		return NULL;
 
+	cl_int error = CL_SUCCESS;
+	OpenCLManager *manager = new OpenCLManager();
+	manager->queue = NULL;
+	manager->context = clCreateContext(0, 1, &device, NULL, NULL, &error);
+	if (manager->context != NULL)
+		manager->queue = clCreateCommandQueue(manager->context, device, CL_QUEUE_PROFILING_ENABLE, &error);
+	if (manager->queue == NULL) {
+		delete manager;
+		return NULL;
+	}
+	manager->platform = platform;
+	manager->device = device;
 	return manager;
 }
+bool Raytracer::isOpenCLDevice(const std::string &device) {
+	unsigned platform, index;
+	char separator;
+	istringstream stream(device);
+	return device == "cpu" || device == "gpu" || ((stream >> platform >> separator >> index) && separator == ':' && stream.peek() == EOF);
+}
+OpenCLManager *Raytracer::createOpenCLManager(const std::string &device) {
+	if (device == "cpu")
+		return createOpenCLManager(CL_DEVICE_TYPE_CPU);
+	if (device.empty() || device == "gpu")
+		return createOpenCLManager(CL_DEVICE_TYPE_GPU);
+	if (!isOpenCLDevice(device)) {
+		cout << "Invalid device '" << device << "'!" << endl;
+		return NULL;
+	}
+	unsigned platform, index;
+	char separator;
+	istringstream stream(device);
+	stream >> platform >> separator >> index;
+	return createOpenCLManager(platform, index);
+}
 bool saveOpenCLManager(OpenCLManager *manager) {
 	return true;
 }
-OpenCLKernel *Raytracer::createOpenCLKernel(OpenCLManager *manager, std::string filename, std::string kernelName) {
+OpenCLKernel *Raytracer::createOpenCLKernel(OpenCLManager *manager, std::string filename, std::string kernelName, std::string options) {
 	OpenCLKernel *kernel = new OpenCLKernel();
-	bool result = kernel->create(manager, filename, kernelName);
+	bool result = kernel->create(manager, filename, kernelName, options);
 	if (result == false && kernel->isErrors() == false)
 		return NULL;
 	else
 		return kernel;
+}
+double Raytracer::getElapsedTime(cl_event start, cl_event end) {
+	cl_ulong startTime = 0, endTime = 0;
+	if (clGetEventProfilingInfo(start, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &startTime, NULL) != CL_SUCCESS)
+		return 0;
+	if (clGetEventProfilingInfo(end, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &endTime, NULL) != CL_SUCCESS)
+		return 0;
+	return (endTime - startTime) / 1000000.0;
+}
+SceneInstance Raytracer::createSceneInstance(int object, const CMatrix4x4 &objectToWorld, int material) {
+	SceneInstance instance;
+	CMatrix4x4 worldToObject = CMatrix4x4::inverseAffine(objectToWorld);
+	for (int i = 0; i < 16; i++)
+		instance.transform[i] = worldToObject.data()[i];
+	instance.object = object;
+	instance.material = material;
+	instance.padding[0] = instance.padding[1] = 0;
+	return instance;
+}
+RenderContext *Raytracer::createRenderContext(OpenCLManager *manager, unsigned maxWidth, unsigned maxHeight, unsigned maxSamples, const std::string &kernelOptions) {
+	RenderContext *context = new RenderContext(manager);
+	if (context->create(maxWidth, maxHeight, maxSamples, kernelOptions) == false) {
+		delete context;
+		return NULL;
+	}
+	return context;
 }
\ No newline at end of file
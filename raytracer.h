@@ -26,13 +26,18 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <map>
+#include <mutex>
 
 #include "mathematics.h"
 
 class Raytracer;
+class OpenCLKernel;
+class RenderContext;
 
 class OpenCLManager {
 	friend Raytracer;
+	friend OpenCLKernel;
 
 	private:
 		OpenCLManager(){}
@@ -43,6 +48,8 @@ class OpenCLManager {
 		cl_command_queue queue;
 		cl_platform_id platform;
 		cl_device_id device;
+		std::map<std::string, cl_program> programs;	// built programs by file and options, shared by kernels
+		std::mutex programsMutex;
 
 	public:
 		~OpenCLManager();
@@ -50,6 +57,7 @@ class OpenCLManager {
 		cl_command_queue getQueue() const;
 		cl_platform_id getPlatformId() const;
 		cl_device_id getDeviceId() const;
+		bool isHostUnifiedMemory() const;	// device shares memory with host, e.g. integrated GPU or CPU
 };
 
 class OpenCLKernel {
@@ -59,7 +67,7 @@ class OpenCLKernel {
 		OpenCLKernel(){}
 		OpenCLKernel(const OpenCLKernel&){}
 		OpenCLKernel& operator=(OpenCLKernel &x){ return x; }
-		bool create(OpenCLManager *manager, std::string filename, std::string kernelName);
+		bool create(OpenCLManager *manager, std::string filename, std::string kernelName, std::string options);
 
 		cl_program program;
 		cl_kernel kernel;
@@ -73,13 +81,27 @@ class OpenCLKernel {
 		bool isErrors() const;
 };
 
+// same layout as struct Instance in kernel.cl
+struct SceneInstance {
+	cl_float transform[16];	// world to object space
+	cl_int object;
+	cl_int material;
+	cl_int padding[2];
+};
+
 class Raytracer {
 	public:
 		static OpenCLManager *createOpenCLManager(); 
 		static OpenCLManager *createOpenCLManager(char *filename);
 		static OpenCLManager *createOpenCLManager(unsigned platform, unsigned device);
+		static OpenCLManager *createOpenCLManager(cl_device_type type);	// first device of this type, without asking
+		static OpenCLManager *createOpenCLManager(const std::string &device);	// <platform>:<device>, cpu or gpu, empty for the first GPU, without asking
+		static bool isOpenCLDevice(const std::string &device);
 		static bool saveOpenCLManager(OpenCLManager *manager);
-		static OpenCLKernel *createOpenCLKernel(OpenCLManager *manager, std::string filename, std::string kernelName);
+		static OpenCLKernel *createOpenCLKernel(OpenCLManager *manager, std::string filename, std::string kernelName, std::string options = "");	// options are passed to clBuildProgram
+		static double getElapsedTime(cl_event start, cl_event end);	// in ms, queue must have profiling enabled
+		static SceneInstance createSceneInstance(int object, const CMatrix4x4 &objectToWorld, int material = -1);
+		static RenderContext *createRenderContext(OpenCLManager *manager, unsigned maxWidth, unsigned maxHeight, unsigned maxSamples, const std::string &kernelOptions = "");	// options of kernel.cl, e.g. -D SPHERE_GROUP_WIDTH=8
 };
 
 
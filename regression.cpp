@@ -0,0 +1,251 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "regression.h"
+#include "rendercontext.h"
+#include "image.h"
+#include <cstdlib>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+
+const unsigned WIDTH = 320;
+const unsigned HEIGHT = 180;
+const int FRAMES = 5;	// fastest frame is taken to filter out noise
+const double MAX_RMSE = 2.0;	// on 0-255 scale
+const double MAX_SLOWDOWN = 0.15;	// throughput may drop by 15% at most
+
+const RegressionScene SCENES[] = {
+	{ "overview", { 14, 10, 14 }, { 0, 2, 0 }, 4, false },
+	{ "closeup", { -1, 4, -14 }, { -7, 3, -7 }, 4, false },
+	{ "ring", { 18, 1.5f, 0 }, { 0, 0.6f, 0 }, 4, false },
+	{ "denoised", { 14, 10, 14 }, { 0, 2, 0 }, 1, true },
+};
+const int SCENE_COUNT = sizeof(SCENES) / sizeof(SCENES[0]);
+
+// sphere group variants of kernel.cl compared on the first scene, scalar path is the reference
+struct GroupVariant {
+	const char *name;
+	const char *options;
+};
+const GroupVariant GROUP_VARIANTS[] = {
+	{ "scalar", "-D SCALAR_SPHERE_GROUPS" },
+	{ "float4", "-D SPHERE_GROUP_WIDTH=4" },
+	{ "float8", "-D SPHERE_GROUP_WIDTH=8" },
+};
+const int GROUP_VARIANT_COUNT = sizeof(GROUP_VARIANTS) / sizeof(GROUP_VARIANTS[0]);
+
+struct Baseline {
+	double time;
+	cl_uint rays;
+};
+
+static bool loadBaseline(const string &filename, map<string, Baseline> &baseline) {
+	ifstream file(filename.c_str());
+	if (!file) {
+		cout << "Can't open file '" << filename << "'!" << endl;
+		return false;
+	}
+	string name;
+	Baseline entry;
+	while (file >> name >> entry.time >> entry.rays)
+		baseline[name] = entry;
+	return true;
+}
+
+static double computeRMSE(const vector<unsigned char> &a, const vector<unsigned char> &b) {
+	double sum = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		double d = (double)a[i] - b[i];
+		sum += d * d;
+	}
+	return sqrt(sum / a.size());
+}
+
+// renders FRAMES frames of the scene, time is the fastest render kernel time in ms
+static bool renderScene(RenderContext *context, const RegressionScene &scene, vector<unsigned char> &rgb, double &time, cl_uint &rays) {
+	context->setCamera(CVector3D(scene.position[0], scene.position[1], scene.position[2]), CVector3D(scene.lookAt[0], scene.lookAt[1], scene.lookAt[2]), CVector3D(0, 1, 0));
+	context->setSamples(scene.samples);
+	context->setDenoise(scene.denoise);
+
+	RenderFrame frame;
+	for (int i = 0; i < FRAMES; i++) {
+		if (!context->renderAsync() || !context->readback(frame))
+			return false;
+		time = (i == 0 ? frame.renderTime : min(time, frame.renderTime));
+	}
+	rgb.resize(3 * frame.width * frame.height);
+	frameToRGB(frame, &rgb[0]);
+	rays = frame.rayCount;
+	return true;
+}
+
+// reports throughput of every sphere group variant, fails only when images differ
+static bool compareGroupVariants(OpenCLManager *manager, const vector<SceneInstance> &instances) {
+	const RegressionScene &scene = SCENES[0];
+	vector<unsigned char> reference;
+	double referenceThroughput = 0;
+	bool result = true;
+	cout << "Sphere groups (" << scene.name << "):" << endl;
+	for (int i = 0; i < GROUP_VARIANT_COUNT; i++) {
+		srand(1);
+		RenderContext *context = Raytracer::createRenderContext(manager, WIDTH, HEIGHT, scene.samples, GROUP_VARIANTS[i].options);
+		if (context == NULL) {
+			cout << "RenderContext can't create!" << endl;
+			return false;
+		}
+		context->setScene(instances);
+		context->setRayCounting(true);
+
+		vector<unsigned char> rgb;
+		double time = 0;
+		cl_uint rays = 0;
+		bool rendered = renderScene(context, scene, rgb, time, rays);
+		delete context;
+		if (!rendered)
+			return false;
+
+		double throughput = rays / max(time, 0.001) / 1000;
+		cout << setw(10) << left << GROUP_VARIANTS[i].name << right << setw(9) << time << " ms" << setw(9) << throughput << " Mrays/s";
+		if (i == 0) {
+			reference = rgb;
+			referenceThroughput = throughput;
+			cout << endl;
+			continue;
+		}
+
+		double rmse = computeRMSE(rgb, reference);
+		cout << "  x" << throughput / max(referenceThroughput, 0.001) << " of scalar  rmse " << rmse;
+		if (rmse > MAX_RMSE) {
+			cout << "  FAILED";
+			result = false;
+		}
+		cout << endl;
+	}
+	return result;
+}
+
+bool Regression::run(OpenCLManager *manager, const std::vector<SceneInstance> &instances, const std::string &directory, bool update, const std::string &kernelOptions) {
+	const string baselineFile = directory + "/baseline.txt";
+	map<string, Baseline> baseline;
+	if (!update && !loadBaseline(baselineFile, baseline))
+		return false;
+
+	// sampler is filled with rand(), fixed seed keeps golden images reproducible
+	srand(1);
+	unsigned maxSamples = 1;
+	for (int i = 0; i < SCENE_COUNT; i++)
+		maxSamples = max(maxSamples, SCENES[i].samples);
+	RenderContext *context = Raytracer::createRenderContext(manager, WIDTH, HEIGHT, maxSamples, kernelOptions);
+	if (context == NULL) {
+		cout << "RenderContext can't create!" << endl;
+		return false;
+	}
+	context->setScene(instances);
+	context->setRayCounting(true);
+
+	ostringstream baselineOut;
+	int failures = 0;
+	cout << fixed << setprecision(2);
+	for (int i = 0; i < SCENE_COUNT; i++) {
+		const RegressionScene &scene = SCENES[i];
+		vector<unsigned char> rgb;
+		double time = 0;
+		cl_uint rays = 0;
+		if (!renderScene(context, scene, rgb, time, rays)) {
+			delete context;
+			return false;
+		}
+
+		string golden = directory + "/" + scene.name + ".ppm";
+		double throughput = rays / max(time, 0.001) / 1000;	// Mrays/s
+		cout << setw(10) << left << scene.name << right << setw(9) << time << " ms" << setw(9) << throughput << " Mrays/s";
+
+		if (update) {
+			if (!saveImagePPM(golden, &rgb[0], WIDTH, HEIGHT)) {
+				cout << "  can't save '" << golden << "'!" << endl;
+				failures++;
+				continue;
+			}
+			baselineOut << scene.name << " " << time << " " << rays << endl;
+			cout << "  updated" << endl;
+			continue;
+		}
+
+		vector<unsigned char> reference;
+		unsigned width = 0, height = 0;
+		bool passed = true;
+		if (!loadImagePPM(golden, reference, width, height) || width != WIDTH || height != HEIGHT) {
+			cout << "  missing golden image";
+			passed = false;
+		}
+		else {
+			double rmse = computeRMSE(rgb, reference);
+			cout << "  rmse " << rmse;
+			if (rmse > MAX_RMSE) {
+				cout << " > " << MAX_RMSE;
+				passed = false;
+			}
+		}
+
+		map<string, Baseline>::const_iterator entry = baseline.find(scene.name);
+		if (entry == baseline.end()) {
+			cout << "  no baseline";
+			passed = false;
+		}
+		else {
+			double baseThroughput = entry->second.rays / max(entry->second.time, 0.001) / 1000;
+			cout << "  baseline " << baseThroughput << " Mrays/s";
+			if (throughput < baseThroughput * (1 - MAX_SLOWDOWN)) {
+				cout << " (slower)";
+				passed = false;
+			}
+			if (rays != entry->second.rays)
+				cout << "  rays " << entry->second.rays << " -> " << rays;
+		}
+
+		// failed image is kept next to the golden one for comparison
+		if (!passed) {
+			saveImagePPM(directory + "/" + scene.name + ".actual.ppm", &rgb[0], WIDTH, HEIGHT);
+			failures++;
+		}
+		cout << (passed ? "  ok" : "  FAILED") << endl;
+	}
+	delete context;
+
+	// vector images must match the scalar one within MAX_RMSE, throughput is only printed
+	if (!compareGroupVariants(manager, instances))
+		failures++;
+
+	if (update) {
+		ofstream file(baselineFile.c_str());
+		file << baselineOut.str();
+		if (!file.good()) {
+			cout << "Can't save '" << baselineFile << "'!" << endl;
+			return false;
+		}
+	}
+
+	cout << (failures == 0 ? "All checks passed" : "Some checks FAILED") << endl;
+	return failures == 0;
+}
@@ -0,0 +1,45 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef RAYTRACER_REGRESSION
+#define RAYTRACER_REGRESSION
+
+#include <string>
+#include <vector>
+
+#include "raytracer.h"
+
+// reference view of the scene, golden image is stored as <directory>/<name>.ppm
+struct RegressionScene {
+	const char *name;
+	float position[3];
+	float lookAt[3];	// point the camera looks at
+	unsigned samples;
+	bool denoise;
+};
+
+// Renders reference scenes headlessly and compares them with golden images and baseline
+// timings from the directory, update stores the current results as the new references.
+class Regression {
+	public:
+		static bool run(OpenCLManager *manager, const std::vector<SceneInstance> &instances, const std::string &directory, bool update, const std::string &kernelOptions);
+};
+
+#endif
@@ -0,0 +1,554 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "rendercontext.h"
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+const float RenderContext::DENOISE_COLOR_PHI = 0.5f;
+
+void frameToRGB(const RenderFrame &frame, unsigned char *rgb) {
+	for (unsigned y = 0; y < frame.height; y++) {
+		for (unsigned x = 0; x < frame.width; x++) {
+			const cl_float *pixel = frame.pixels[y * frame.width + x].s;
+			unsigned char *out = rgb + 3 * ((frame.height - 1 - y) * frame.width + x);
+			for (int c = 0; c < 3; c++)
+				out[c] = (unsigned char)(max(0.0f, min(1.0f, pixel[c])) * 255);
+		}
+	}
+}
+
+RenderContext::RenderContext(OpenCLManager *manager) {
+	this->manager = manager;
+	kernel = denoiseKernel = reprojectKernel = reconstructKernel = NULL;
+	maxWidth = maxHeight = maxSamples = 0;
+	width = height = samples = 0;
+	denoise = temporal = historyValid = countRays = false;
+	interleave = 1;
+	phase = 0;
+	reconstructValid = false;
+	setCamera(CVector3D(0, 0, 0), CVector3D(0, 0, 1), CVector3D(0, 1, 0));
+	zeroCopy = false;
+	sceneVersion = 0;
+	albedoB = denoiseB = reconstructB = NULL;
+	for (int i = 0; i < 2; i++)
+		normalDepthB[i] = historyB[i] = NULL;
+	current = 0;
+	for (int i = 0; i < SLOTS; i++) {
+		slots[i].output = slots[i].samplerB = slots[i].instancesB = slots[i].rayCountB = NULL;
+		slots[i].sceneCapacity = 0;
+		slots[i].sceneVersion = 0;
+		slots[i].mappedOutput = NULL;
+		slots[i].mappedSampler = NULL;
+		slots[i].mappedScene = NULL;
+		slots[i].renderEvent = slots[i].reconstructEvent = slots[i].reprojectEvent = slots[i].readEvent = NULL;
+		slots[i].mapEvents[0] = slots[i].mapEvents[1] = NULL;
+		for (int j = 0; j < DENOISE_ITERATIONS; j++)
+			slots[i].denoiseEvents[j] = NULL;
+		slots[i].copiedBytes = 0;
+	}
+	nextSlot = 0;
+	pending = 0;
+}
+RenderContext::~RenderContext() {
+	clFinish(manager->getQueue());
+	for (int i = 0; i < SLOTS; i++) {
+		releaseEvents(slots[i]);
+		unmapAll(slots[i]);
+	}
+	clFinish(manager->getQueue());
+	for (int i = 0; i < SLOTS; i++) {
+		cl_mem buffers[] = { slots[i].output, slots[i].samplerB, slots[i].instancesB, slots[i].rayCountB };
+		for (int j = 0; j < 4; j++)
+			if (buffers[j] != NULL)
+				clReleaseMemObject(buffers[j]);
+	}
+
+	cl_mem buffers[] = { albedoB, denoiseB, reconstructB, normalDepthB[0], normalDepthB[1], historyB[0], historyB[1] };
+	for (int i = 0; i < 7; i++)
+		if (buffers[i] != NULL)
+			clReleaseMemObject(buffers[i]);
+
+	delete kernel;
+	delete denoiseKernel;
+	delete reprojectKernel;
+	delete reconstructKernel;
+}
+
+bool RenderContext::create(unsigned maxWidth, unsigned maxHeight, unsigned maxSamples, const std::string &kernelOptions) {
+	this->maxWidth = width = maxWidth;
+	this->maxHeight = height = maxHeight;
+	this->maxSamples = samples = maxSamples;
+
+	string files[] = { "kernel.cl", "postprocess.cl", "postprocess.cl", "postprocess.cl" };
+	string names[] = { "main", "denoise", "reproject", "reconstruct" };
+	string options[] = { kernelOptions, "", "", "" };
+	OpenCLKernel **kernels[] = { &kernel, &denoiseKernel, &reprojectKernel, &reconstructKernel };
+	for (int i = 0; i < 4; i++) {
+		*kernels[i] = Raytracer::createOpenCLKernel(manager, files[i], names[i], options[i]);
+		if (*kernels[i] == NULL) {
+			cout << "OpenCLKernel can't create!" << endl;
+			return false;
+		}
+		else if ((*kernels[i])->isErrors()) {
+			cout << "Compiletion failed!" << endl << (*kernels[i])->getBuildInfo() << endl;
+			return false;
+		}
+	}
+
+	size_t area = maxWidth*maxHeight;
+	albedoB = createBuffer(CL_MEM_READ_WRITE, area*sizeof(cl_float4));
+	denoiseB = createBuffer(CL_MEM_READ_WRITE, area*sizeof(cl_float4));
+	reconstructB = createBuffer(CL_MEM_READ_WRITE, area*sizeof(cl_float4));
+	if (albedoB == NULL || denoiseB == NULL || reconstructB == NULL)
+		return false;
+	for (int i = 0; i < 2; i++) {
+		normalDepthB[i] = createBuffer(CL_MEM_READ_WRITE, area*sizeof(cl_float4));
+		historyB[i] = createBuffer(CL_MEM_READ_WRITE, area*sizeof(cl_float4));
+		if (normalDepthB[i] == NULL || historyB[i] == NULL)
+			return false;
+	}
+	// host visible buffers are only worth it when device reads host memory directly
+	zeroCopy = manager->isHostUnifiedMemory();
+	cl_mem_flags hostFlags = (zeroCopy ? CL_MEM_ALLOC_HOST_PTR : 0);
+	vector<cl_float> sampler(2*maxSamples);
+	for (unsigned i = 0; i < sampler.size(); i++)
+		sampler[i] = (rand() % 10) / 10.0f;
+	for (int i = 0; i < SLOTS; i++) {
+		Slot &slot = slots[i];
+		slot.output = createBuffer(CL_MEM_READ_WRITE | hostFlags, area*sizeof(cl_float4));
+		slot.samplerB = createBuffer(CL_MEM_READ_ONLY | hostFlags, sampler.size()*sizeof(cl_float));
+		slot.rayCountB = createBuffer(CL_MEM_READ_WRITE, sizeof(cl_uint));
+		if (slot.output == NULL || slot.samplerB == NULL || slot.rayCountB == NULL)
+			return false;
+
+		if (zeroCopy) {
+			if (!mapInputs(slot, CL_TRUE))
+				return false;
+			memcpy(slot.mappedSampler, &sampler[0], sampler.size()*sizeof(cl_float));
+		}
+		else {
+			slot.pixels.resize(4*area);
+			slot.sampler = sampler;
+			if (clEnqueueWriteBuffer(manager->getQueue(), slot.samplerB, CL_TRUE, 0, sampler.size()*sizeof(cl_float), &sampler[0], 0, NULL, NULL) != CL_SUCCESS) {
+				cout << "clEnqueueWriteBuffer: sampler!" << endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+cl_mem RenderContext::createBuffer(cl_mem_flags flags, size_t size) {
+	cl_int error = CL_SUCCESS;
+	cl_mem buffer = clCreateBuffer(manager->getContext(), flags, size, NULL, &error);
+	if (error != CL_SUCCESS) {
+		cout << "Buffer can't create!" << endl;
+		return NULL;
+	}
+	return buffer;
+}
+bool RenderContext::setArg(OpenCLKernel *kernel, cl_uint index, size_t size, const void *value, const char *name) {
+	if (clSetKernelArg(kernel->getKernel(), index, size, value) != CL_SUCCESS) {
+		cout << "Set kernel arg: " << name << "!" << endl;
+		return false;
+	}
+	return true;
+}
+bool RenderContext::enqueue(OpenCLKernel *kernel, size_t area, cl_event *event) {
+	cl_int error = clEnqueueNDRangeKernel(manager->getQueue(), kernel->getKernel(), 1, NULL, &area, NULL, 0, NULL, event);
+	if (error != CL_SUCCESS) {
+		cout << "clEnqueueNDRangeKernel!: " << error << endl;
+		return false;
+	}
+	return true;
+}
+void RenderContext::releaseEvents(Slot &slot) {
+	cl_event *events[] = { &slot.renderEvent, &slot.reconstructEvent, &slot.reprojectEvent, &slot.readEvent, &slot.mapEvents[0], &slot.mapEvents[1] };
+	for (int i = 0; i < 6; i++) {
+		if (*events[i] != NULL)
+			clReleaseEvent(*events[i]);
+		*events[i] = NULL;
+	}
+	for (int i = 0; i < DENOISE_ITERATIONS; i++) {
+		if (slot.denoiseEvents[i] != NULL)
+			clReleaseEvent(slot.denoiseEvents[i]);
+		slot.denoiseEvents[i] = NULL;
+	}
+}
+bool RenderContext::createSceneBuffer(Slot &slot, size_t count) {
+	if (slot.instancesB != NULL) {
+		if (slot.mappedScene != NULL)
+			clEnqueueUnmapMemObject(manager->getQueue(), slot.instancesB, slot.mappedScene, 0, NULL, NULL);
+		slot.mappedScene = NULL;
+		clReleaseMemObject(slot.instancesB);
+	}
+	slot.instancesB = createBuffer(CL_MEM_READ_ONLY | (zeroCopy ? CL_MEM_ALLOC_HOST_PTR : 0), count*sizeof(SceneInstance));
+	slot.sceneCapacity = (slot.instancesB != NULL ? count : 0);
+	if (slot.instancesB == NULL)
+		return false;
+
+	// blocking map waits for frames in flight, but only happens when scene grows
+	return !zeroCopy || mapInputs(slot, CL_TRUE);
+}
+bool RenderContext::mapInputs(Slot &slot, cl_bool blocking) {
+	cl_int error = CL_SUCCESS;
+	if (slot.mappedSampler == NULL) {
+		slot.mappedSampler = (cl_float*)clEnqueueMapBuffer(manager->getQueue(), slot.samplerB, blocking, CL_MAP_WRITE, 0, 2*maxSamples*sizeof(cl_float),
+			0, NULL, (blocking ? NULL : &slot.mapEvents[0]), &error);
+		if (error != CL_SUCCESS) {
+			cout << "clEnqueueMapBuffer: sampler!" << endl;
+			return false;
+		}
+	}
+	if (slot.mappedScene == NULL && slot.instancesB != NULL) {
+		slot.mappedScene = (SceneInstance*)clEnqueueMapBuffer(manager->getQueue(), slot.instancesB, blocking, CL_MAP_WRITE, 0, slot.sceneCapacity*sizeof(SceneInstance),
+			0, NULL, (blocking ? NULL : &slot.mapEvents[1]), &error);
+		if (error != CL_SUCCESS) {
+			cout << "clEnqueueMapBuffer: instances!" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+bool RenderContext::unmapAll(Slot &slot) {
+	cl_mem buffers[] = { slot.output, slot.samplerB, slot.instancesB };
+	void **pointers[] = { (void**)&slot.mappedOutput, (void**)&slot.mappedSampler, (void**)&slot.mappedScene };
+	bool result = true;
+	for (int i = 0; i < 3; i++) {
+		if (*pointers[i] == NULL)
+			continue;
+		if (clEnqueueUnmapMemObject(manager->getQueue(), buffers[i], *pointers[i], 0, NULL, NULL) != CL_SUCCESS) {
+			cout << "clEnqueueUnmapMemObject!" << endl;
+			result = false;
+		}
+		*pointers[i] = NULL;
+	}
+	return result;
+}
+
+void RenderContext::setScene(const std::vector<SceneInstance> &instances) {
+	scene = instances;
+	sceneVersion++;
+}
+void RenderContext::setCamera(const CVector3D &position, const CVector3D &lookAt, const CVector3D &up) {
+	const CVector3D *vectors[] = { &position, &lookAt, &up };
+	cl_float *targets[] = { this->position, this->lookAt, this->up };
+	for (int i = 0; i < 3; i++) {
+		targets[i][0] = vectors[i]->x;
+		targets[i][1] = vectors[i]->y;
+		targets[i][2] = vectors[i]->z;
+		targets[i][3] = 0;
+	}
+}
+bool RenderContext::setResolution(unsigned width, unsigned height) {
+	if (width == 0 || height == 0 || width > maxWidth || height > maxHeight)
+		return false;
+	if (width != this->width || height != this->height)
+		historyValid = reconstructValid = false;
+	this->width = width;
+	this->height = height;
+	return true;
+}
+void RenderContext::setSamples(unsigned samples) {
+	this->samples = max(1u, min(samples, maxSamples));
+}
+void RenderContext::setDenoise(bool enabled) {
+	denoise = enabled;
+}
+void RenderContext::setTemporal(bool enabled) {
+	if (enabled != temporal)
+		historyValid = false;
+	temporal = enabled;
+}
+void RenderContext::setRayCounting(bool enabled) {
+	countRays = enabled;
+}
+bool RenderContext::setInterleave(unsigned interleave) {
+	if (interleave != 1 && interleave != 2 && interleave != 4)
+		return false;
+	if (interleave != this->interleave) {
+		reconstructValid = false;
+		phase = 0;
+	}
+	this->interleave = interleave;
+	return true;
+}
+void RenderContext::resetHistory() {
+	historyValid = reconstructValid = false;
+}
+unsigned RenderContext::getMaxWidth() const {
+	return maxWidth;
+}
+unsigned RenderContext::getMaxHeight() const {
+	return maxHeight;
+}
+unsigned RenderContext::getSamples() const {
+	return samples;
+}
+unsigned RenderContext::getInterleave() const {
+	return interleave;
+}
+bool RenderContext::isZeroCopy() const {
+	return zeroCopy;
+}
+
+bool RenderContext::renderAsync() {
+	if (pending == SLOTS) {
+		cout << "Too many frames in flight!" << endl;
+		return false;
+	}
+	if (scene.empty()) {
+		cout << "Scene is empty!" << endl;
+		return false;
+	}
+
+	// inputs stay unmapped only when an earlier reset could not map them
+	Slot &slot = slots[nextSlot];
+	releaseEvents(slot);
+	if (zeroCopy && !mapInputs(slot, CL_TRUE))
+		return false;
+	if (!submit(slot)) {
+		resetSlot(slot);
+		return false;
+	}
+	clFlush(manager->getQueue());
+
+	if (interleave > 1) {
+		phase = (phase + 1) % interleave;
+		reconstructValid = true;
+	}
+	if (temporal) {
+		memcpy(prevPosition, position, sizeof(prevPosition));
+		memcpy(prevLookAt, lookAt, sizeof(prevLookAt));
+		memcpy(prevUp, up, sizeof(prevUp));
+		historyValid = true;
+		current = 1 - current;
+	}
+	nextSlot = (nextSlot + 1) % SLOTS;
+	pending++;
+	return true;
+}
+bool RenderContext::submit(Slot &slot) {
+	// host data belongs to the slot, so nothing is changed while the device may still read it
+	size_t area = width*height;
+	slot.width = width;
+	slot.height = height;
+	slot.temporal = temporal;
+	slot.denoise = denoise;
+	slot.countRays = countRays;
+	slot.interleave = interleave;
+	slot.copiedBytes = 0;
+	slot.rayCount = 0;
+
+	// new jitter every frame lets temporal history converge to an antialiased image
+	if (temporal) {
+		cl_float *sampler = (zeroCopy ? slot.mappedSampler : &slot.sampler[0]);
+		for (unsigned i = 0; i < 2*maxSamples; i++)
+			sampler[i] = (rand() % 10) / 10.0f;
+		if (!zeroCopy) {
+			if (clEnqueueWriteBuffer(manager->getQueue(), slot.samplerB, CL_FALSE, 0, slot.sampler.size()*sizeof(cl_float), &slot.sampler[0], 0, NULL, NULL) != CL_SUCCESS) {
+				cout << "clEnqueueWriteBuffer: sampler!" << endl;
+				return false;
+			}
+			slot.copiedBytes += slot.sampler.size()*sizeof(cl_float);
+		}
+	}
+
+	if (slot.sceneVersion != sceneVersion) {
+		if (scene.size() > slot.sceneCapacity && !createSceneBuffer(slot, scene.size()))
+			return false;
+		if (zeroCopy) {
+			memcpy(slot.mappedScene, &scene[0], scene.size()*sizeof(SceneInstance));
+		}
+		else {
+			slot.scene = scene;
+			if (clEnqueueWriteBuffer(manager->getQueue(), slot.instancesB, CL_FALSE, 0, scene.size()*sizeof(SceneInstance), &slot.scene[0], 0, NULL, NULL) != CL_SUCCESS) {
+				cout << "clEnqueueWriteBuffer: instances!" << endl;
+				return false;
+			}
+			slot.copiedBytes += scene.size()*sizeof(SceneInstance);
+		}
+		slot.sceneVersion = sceneVersion;
+	}
+	if (zeroCopy && !unmapAll(slot))
+		return false;
+
+	if (countRays) {
+		if (clEnqueueWriteBuffer(manager->getQueue(), slot.rayCountB, CL_FALSE, 0, sizeof(cl_uint), &slot.rayCount, 0, NULL, NULL) != CL_SUCCESS) {
+			cout << "clEnqueueWriteBuffer: rayCount!" << endl;
+			return false;
+		}
+		slot.copiedBytes += sizeof(cl_uint);
+	}
+
+	// dispatch covers only pixels traced in this phase, see interleavedPixel in kernel.cl
+	size_t traced = area;
+	if (interleave == 2)
+		traced = (width + 1) / 2 * height;
+	else if (interleave == 4)
+		traced = (width + 1) / 2 * ((height + 1) / 2);
+
+	cl_uint instanceCount = scene.size();
+	bool result = setArg(kernel, 0, sizeof(cl_mem), &slot.output, "output")
+		&& setArg(kernel, 1, sizeof(cl_uint), &width, "width")
+		&& setArg(kernel, 2, sizeof(cl_uint), &height, "height")
+		&& setArg(kernel, 3, sizeof(cl_float3), position, "position")
+		&& setArg(kernel, 4, sizeof(cl_float3), lookAt, "lookAt")
+		&& setArg(kernel, 5, sizeof(cl_float3), up, "up")
+		&& setArg(kernel, 6, sizeof(cl_uint), &samples, "samplerCount")
+		&& setArg(kernel, 7, sizeof(cl_mem), &slot.samplerB, "sampler")
+		&& setArg(kernel, 8, sizeof(cl_mem), &slot.instancesB, "instances")
+		&& setArg(kernel, 9, sizeof(cl_uint), &instanceCount, "instanceCount")
+		&& setArg(kernel, 10, sizeof(cl_mem), &albedoB, "albedo")
+		&& setArg(kernel, 11, sizeof(cl_mem), &normalDepthB[current], "normalDepth")
+		&& setArg(kernel, 12, sizeof(cl_mem), (countRays ? &slot.rayCountB : NULL), "rayCount")
+		&& setArg(kernel, 13, sizeof(cl_uint), &interleave, "interleave")
+		&& setArg(kernel, 14, sizeof(cl_uint), &phase, "phase")
+		&& enqueue(kernel, traced, &slot.renderEvent);
+	if (!result)
+		return false;
+
+	if (interleave > 1) {
+		cl_int valid = reconstructValid;
+		result = setArg(reconstructKernel, 0, sizeof(cl_mem), &slot.output, "color")
+			&& setArg(reconstructKernel, 1, sizeof(cl_mem), &albedoB, "albedo")
+			&& setArg(reconstructKernel, 2, sizeof(cl_mem), &normalDepthB[current], "normalDepth")
+			&& setArg(reconstructKernel, 3, sizeof(cl_mem), &reconstructB, "history")
+			&& setArg(reconstructKernel, 4, sizeof(cl_uint), &width, "width")
+			&& setArg(reconstructKernel, 5, sizeof(cl_uint), &height, "height")
+			&& setArg(reconstructKernel, 6, sizeof(cl_uint), &interleave, "interleave")
+			&& setArg(reconstructKernel, 7, sizeof(cl_uint), &phase, "phase")
+			&& setArg(reconstructKernel, 8, sizeof(cl_int), &valid, "historyValid")
+			&& enqueue(reconstructKernel, area, &slot.reconstructEvent);
+		if (!result)
+			return false;
+	}
+
+	if (temporal) {
+		cl_int valid = historyValid;
+		result = setArg(reprojectKernel, 0, sizeof(cl_mem), &slot.output, "color")
+			&& setArg(reprojectKernel, 1, sizeof(cl_mem), &historyB[1 - current], "history")
+			&& setArg(reprojectKernel, 2, sizeof(cl_mem), &historyB[current], "newHistory")
+			&& setArg(reprojectKernel, 3, sizeof(cl_mem), &normalDepthB[current], "normalDepth")
+			&& setArg(reprojectKernel, 4, sizeof(cl_mem), &normalDepthB[1 - current], "prevNormalDepth")
+			&& setArg(reprojectKernel, 5, sizeof(cl_uint), &width, "width")
+			&& setArg(reprojectKernel, 6, sizeof(cl_uint), &height, "height")
+			&& setArg(reprojectKernel, 7, sizeof(cl_float3), position, "position")
+			&& setArg(reprojectKernel, 8, sizeof(cl_float3), lookAt, "lookAt")
+			&& setArg(reprojectKernel, 9, sizeof(cl_float3), up, "up")
+			&& setArg(reprojectKernel, 10, sizeof(cl_float3), prevPosition, "prevPosition")
+			&& setArg(reprojectKernel, 11, sizeof(cl_float3), prevLookAt, "prevLookAt")
+			&& setArg(reprojectKernel, 12, sizeof(cl_float3), prevUp, "prevUp")
+			&& setArg(reprojectKernel, 13, sizeof(cl_int), &valid, "historyValid")
+			&& enqueue(reprojectKernel, area, &slot.reprojectEvent);
+		if (!result)
+			return false;
+	}
+
+	// a-trous iterations ping-pong between output and denoiseB, even count ends in output
+	if (denoise) {
+		cl_mem buffers[] = { slot.output, denoiseB };
+		for (int i = 0; i < DENOISE_ITERATIONS && result; i++) {
+			cl_int stepWidth = 1 << i;
+			cl_float colorPhi = DENOISE_COLOR_PHI / (1 << i);
+			result = setArg(denoiseKernel, 0, sizeof(cl_mem), &buffers[i % 2], "input")
+				&& setArg(denoiseKernel, 1, sizeof(cl_mem), &buffers[(i + 1) % 2], "output")
+				&& setArg(denoiseKernel, 2, sizeof(cl_mem), &albedoB, "albedo")
+				&& setArg(denoiseKernel, 3, sizeof(cl_mem), &normalDepthB[current], "normalDepth")
+				&& setArg(denoiseKernel, 4, sizeof(cl_uint), &width, "width")
+				&& setArg(denoiseKernel, 5, sizeof(cl_uint), &height, "height")
+				&& setArg(denoiseKernel, 6, sizeof(cl_int), &stepWidth, "stepWidth")
+				&& setArg(denoiseKernel, 7, sizeof(cl_float), &colorPhi, "colorPhi")
+				&& enqueue(denoiseKernel, area, &slot.denoiseEvents[i]);
+		}
+		if (!result)
+			return false;
+	}
+
+	// in-order queue, so waiting for readEvent covers this read too
+	if (countRays) {
+		if (clEnqueueReadBuffer(manager->getQueue(), slot.rayCountB, CL_FALSE, 0, sizeof(cl_uint), &slot.rayCount, 0, NULL, NULL) != CL_SUCCESS) {
+			cout << "clEnqueueReadBuffer: rayCount!" << endl;
+			return false;
+		}
+		slot.copiedBytes += sizeof(cl_uint);
+	}
+
+	// host takes zero-copy buffers back as soon as the frame is done
+	if (zeroCopy) {
+		cl_int error = CL_SUCCESS;
+		slot.mappedOutput = (cl_float4*)clEnqueueMapBuffer(manager->getQueue(), slot.output, CL_FALSE, CL_MAP_READ, 0, area*sizeof(cl_float4), 0, NULL, &slot.readEvent, &error);
+		if (error != CL_SUCCESS) {
+			cout << "clEnqueueMapBuffer: output!" << endl;
+			return false;
+		}
+		if (!mapInputs(slot, CL_FALSE))
+			return false;
+	}
+	else {
+		if (clEnqueueReadBuffer(manager->getQueue(), slot.output, CL_FALSE, 0, area*sizeof(cl_float4), &slot.pixels[0], 0, NULL, &slot.readEvent) != CL_SUCCESS) {
+			cout << "clEnqueueReadBuffer!" << endl;
+			return false;
+		}
+		slot.copiedBytes += area*sizeof(cl_float4);
+	}
+	return true;
+}
+// waits for commands already enqueued for the slot, so its events and host memory can be reused,
+// scene is uploaded again and history buffers may be half written
+void RenderContext::resetSlot(Slot &slot) {
+	clFinish(manager->getQueue());
+	releaseEvents(slot);
+	if (zeroCopy) {
+		unmapAll(slot);
+		mapInputs(slot, CL_TRUE);
+	}
+	slot.sceneVersion = sceneVersion - 1;
+	historyValid = reconstructValid = false;
+}
+bool RenderContext::readback(RenderFrame &frame) {
+	if (pending == 0) {
+		cout << "No frame to read back!" << endl;
+		return false;
+	}
+
+	Slot &slot = slots[(nextSlot - pending + SLOTS) % SLOTS];
+	pending--;
+	cl_event events[] = { slot.readEvent, slot.mapEvents[0], slot.mapEvents[1] };
+	if (clWaitForEvents((zeroCopy ? 3 : 1), events) != CL_SUCCESS) {
+		cout << "clWaitForEvents!" << endl;
+		releaseEvents(slot);
+		return false;
+	}
+
+	frame.pixels = (zeroCopy ? slot.mappedOutput : (const cl_float4*)&slot.pixels[0]);
+	frame.width = slot.width;
+	frame.height = slot.height;
+	frame.renderTime = Raytracer::getElapsedTime(slot.renderEvent, slot.renderEvent);
+	frame.reconstructTime = (slot.interleave > 1 ? Raytracer::getElapsedTime(slot.reconstructEvent, slot.reconstructEvent) : 0);
+	frame.reprojectTime = (slot.temporal ? Raytracer::getElapsedTime(slot.reprojectEvent, slot.reprojectEvent) : 0);
+	frame.denoiseTime = (slot.denoise ? Raytracer::getElapsedTime(slot.denoiseEvents[0], slot.denoiseEvents[DENOISE_ITERATIONS - 1]) : 0);
+	frame.copiedBytes = slot.copiedBytes;
+	frame.rayCount = (slot.countRays ? slot.rayCount : 0);
+	releaseEvents(slot);
+	return true;
+}
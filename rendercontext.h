@@ -0,0 +1,148 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef RAYTRACER_RENDERCONTEXT
+#define RAYTRACER_RENDERCONTEXT
+
+#include <vector>
+
+#include "raytracer.h"
+
+struct RenderFrame {
+	const cl_float4 *pixels;	// rows from bottom to top, valid until next renderAsync or readback
+	unsigned width;
+	unsigned height;
+	double renderTime;	// ms
+	double reconstructTime;
+	double reprojectTime;
+	double denoiseTime;
+	size_t copiedBytes;	// passed through clEnqueueWriteBuffer/ReadBuffer, only the ray counter with zero-copy buffers
+	cl_uint rayCount;	// 0 unless ray counting is enabled
+};
+
+// rgb rows from top to bottom as in image.h, clamped to [0, 1] before conversion
+void frameToRGB(const RenderFrame &frame, unsigned char *rgb);
+
+// Owns kernels and buffers of one renderer. Contexts created with the same manager share
+// its device queue and compiled programs, so only the first context per kernel options
+// pays for clBuildProgram, but each one has to be driven from one thread at a time.
+// On devices with host unified memory output, sampler and scene buffers are allocated in host
+// memory and stay mapped while the host owns them, otherwise they are copied explicitly.
+class RenderContext {
+	friend Raytracer;
+
+	private:
+		static const int SLOTS = 2;	// frames in flight
+		static const int DENOISE_ITERATIONS = 4;
+		static const float DENOISE_COLOR_PHI;
+
+		struct Slot {
+			std::vector<cl_float> pixels;	// host copies, only used without zero-copy
+			std::vector<cl_float> sampler;
+			std::vector<SceneInstance> scene;
+			cl_mem output;
+			cl_mem samplerB;
+			cl_mem instancesB;
+			cl_mem rayCountB;
+			cl_uint rayCount;
+			size_t sceneCapacity;
+			unsigned sceneVersion;
+			cl_float4 *mappedOutput;	// zero-copy pointers, NULL while device owns the buffer
+			cl_float *mappedSampler;
+			SceneInstance *mappedScene;
+			cl_event renderEvent;
+			cl_event reconstructEvent;
+			cl_event reprojectEvent;
+			cl_event denoiseEvents[DENOISE_ITERATIONS];
+			cl_event readEvent;
+			cl_event mapEvents[2];
+			size_t copiedBytes;
+			unsigned width;
+			unsigned height;
+			cl_uint interleave;
+			bool temporal;
+			bool denoise;
+			bool countRays;
+		};
+
+		RenderContext(OpenCLManager *manager);
+		RenderContext(const RenderContext&);
+		RenderContext& operator=(const RenderContext&);
+		bool create(unsigned maxWidth, unsigned maxHeight, unsigned maxSamples, const std::string &kernelOptions);
+		cl_mem createBuffer(cl_mem_flags flags, size_t size);
+		bool setArg(OpenCLKernel *kernel, cl_uint index, size_t size, const void *value, const char *name);
+		bool enqueue(OpenCLKernel *kernel, size_t area, cl_event *event);
+		void releaseEvents(Slot &slot);
+		bool submit(Slot &slot);
+		void resetSlot(Slot &slot);
+		bool createSceneBuffer(Slot &slot, size_t count);
+		bool mapInputs(Slot &slot, cl_bool blocking);
+		bool unmapAll(Slot &slot);
+
+		OpenCLManager *manager;
+		OpenCLKernel *kernel;
+		OpenCLKernel *denoiseKernel;
+		OpenCLKernel *reprojectKernel;
+		OpenCLKernel *reconstructKernel;
+
+		unsigned maxWidth, maxHeight, maxSamples;
+		cl_uint width, height, samples;
+		bool denoise, temporal, historyValid, countRays;
+		cl_float position[4], lookAt[4], up[4];
+		cl_float prevPosition[4], prevLookAt[4], prevUp[4];
+		cl_uint interleave, phase;	// every interleave-th pixel is traced, phase selects which one
+		bool reconstructValid;
+
+		bool zeroCopy;
+		std::vector<SceneInstance> scene;
+		unsigned sceneVersion;	// slots with older version upload the scene again
+
+		cl_mem albedoB, denoiseB, reconstructB;
+		cl_mem normalDepthB[2], historyB[2];
+		int current;	// temporal buffers of this frame, the other ones hold the previous frame
+
+		Slot slots[SLOTS];
+		int nextSlot;
+		int pending;
+
+	public:
+		~RenderContext();
+
+		void setScene(const std::vector<SceneInstance> &instances);
+		void setCamera(const CVector3D &position, const CVector3D &lookAt, const CVector3D &up);	// lookAt is a point
+		bool setResolution(unsigned width, unsigned height);
+		void setSamples(unsigned samples);
+		void setDenoise(bool enabled);
+		void setTemporal(bool enabled);
+		void setRayCounting(bool enabled);	// costs one atomic per pixel and a small readback
+		bool setInterleave(unsigned interleave);	// 1 traces all pixels, 2 a checkerboard, 4 one pixel of every 2x2 block
+		void resetHistory();
+
+		unsigned getMaxWidth() const;
+		unsigned getMaxHeight() const;
+		unsigned getSamples() const;
+		unsigned getInterleave() const;
+		bool isZeroCopy() const;
+
+		bool renderAsync();	// at most SLOTS frames can wait for readback
+		bool readback(RenderFrame &frame);	// waits for the oldest frame
+};
+
+#endif
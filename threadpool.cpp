@@ -0,0 +1,78 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "threadpool.h"
+#include <algorithm>
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned threadCount, size_t maxQueued) {
+	running = 0;
+	this->maxQueued = maxQueued;
+	stop = false;
+	for (unsigned i = 0; i < max(threadCount, 1u); i++)
+		threads.push_back(thread(&ThreadPool::work, this));
+}
+ThreadPool::~ThreadPool() {
+	{
+		unique_lock<std::mutex> lock(mutex);
+		stop = true;
+	}
+	taskAdded.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+void ThreadPool::enqueue(const function<void()> &task) {
+	{
+		unique_lock<std::mutex> lock(mutex);
+		while (maxQueued > 0 && tasks.size() >= maxQueued)
+			taskDone.wait(lock);
+		tasks.push(task);
+	}
+	taskAdded.notify_one();
+}
+void ThreadPool::wait() {
+	unique_lock<std::mutex> lock(mutex);
+	while (!tasks.empty() || running > 0)
+		taskDone.wait(lock);
+}
+void ThreadPool::work() {
+	while (true) {
+		function<void()> task;
+		{
+			unique_lock<std::mutex> lock(mutex);
+			while (!stop && tasks.empty())
+				taskAdded.wait(lock);
+			if (tasks.empty())
+				return;
+			task = tasks.front();
+			tasks.pop();
+			running++;
+		}
+		taskDone.notify_all();
+
+		task();
+
+		{
+			unique_lock<std::mutex> lock(mutex);
+			running--;
+		}
+		taskDone.notify_all();
+	}
+}
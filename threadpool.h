@@ -0,0 +1,53 @@
+/*
+	Copyright 2014 Mateusz Chudyk.
+
+	This file is part of RayTracerGPU.
+
+	RayTracerGPU is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	RayTracerGPU is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with RayTracerGPU; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef RAYTRACER_THREADPOOL
+#define RAYTRACER_THREADPOOL
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+class ThreadPool {
+	private:
+		ThreadPool(const ThreadPool&);
+		ThreadPool& operator=(const ThreadPool&);
+		void work();
+
+		std::vector<std::thread> threads;
+		std::queue<std::function<void()> > tasks;
+		std::mutex mutex;
+		std::condition_variable taskAdded;
+		std::condition_variable taskDone;
+		unsigned running;
+		size_t maxQueued;
+		bool stop;
+
+	public:
+		ThreadPool(unsigned threadCount, size_t maxQueued = 0);	// 0 does not limit the queue
+		~ThreadPool();
+		void enqueue(const std::function<void()> &task);	// blocks while maxQueued tasks are waiting
+		void wait();	// blocks until all enqueued tasks are done
+};
+
+#endif